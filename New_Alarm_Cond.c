@@ -5,296 +5,362 @@
  * which a condition variable to the alarm_mutex.c program. This
  * new version will have two periodic display threads in addition
  * to the main and alarm thread in the alarm_cond.c program.
+ *
+ * The alarm list itself, and the operations on it, are in
+ * alarm_list.c.
+ *
+ * Built with -DALARM_REPLAY (and the virtual clock), the program
+ * replays a scenario instead of taking requests as typed: each
+ * input line is "@t command", and the command is echoed and run
+ * once virtual time reaches t seconds; lines starting with "#" are
+ * comments. See replay/run.sh.
  */
 #include <pthread.h>
 #include <time.h>
 #include "errors.h"
-#include <semaphore.h>
-
-typedef struct alarm_tag {
-    struct alarm_tag    *link;
-    int                 seconds;
-    int                 message_number; /* Message identifier */
-    int                 cancellable; /* Either 0 or 1 */
-    int                 replaced;
-    time_t              time;   /* Seconds from EPOCH */
-    char                message[128]; /* Message */
-} alarm_t;
+#include "alarm_clock.h"
+#include "alarm_list.h"
 
-pthread_mutex_t alarm_mutex = PTHREAD_MUTEX_INITIALIZER;
-pthread_cond_t alarm_cond = PTHREAD_COND_INITIALIZER;
-alarm_t *alarm_list = NULL;
-int current_alarm = 0;
+#if defined(ALARM_REPLAY) && ALARM_CLOCK != ALARM_CLOCK_VIRTUAL
+# error "ALARM_REPLAY needs ALARM_CLOCK_VIRTUAL"
+#endif
+#ifdef ALARM_REPLAY
+# include <sys/resource.h>
+#endif
 
 /*
- * In charge of printing the list of alarms. Since the function
- * needs to access the alarm list, we used a semaphore around
- * the code that prints the alarm list through the use of a
- * simple for loop.
+ * current_alarm is the message number of the request waiting for the
+ * alarm thread, or 0. alarm_mutex protects it, and alarm_cond is
+ * broadcast whenever it changes.
  */
-sem_t rw_mutex;
-sem_t mutex;
-int read_count = 0;
-
-void print_alarm_list() {
-    alarm_t *next;
-
-    sem_wait(&mutex);
-    read_count++;
-    if(read_count == 1)
-        sem_wait(&rw_mutex);
-    sem_post(&mutex);
-
-    printf ("[list: ");
-    for (next = alarm_list; next != NULL; next = next->link)
-        printf ("%ld(%ld)[\"%s\"]", next->time,
-            next->time - time (NULL), next->message);
-    printf ("]\n");
-
-    sem_wait(&mutex);
-    read_count--;
-    if(read_count == 0)
-        sem_post(&rw_mutex);
-    sem_post(&mutex);
-}
-
-/* Fetches the alarm with the given alarm number to it. */
-alarm_t *get_alarm_at(int m_id) {
-    alarm_t *next;
-
-    if(alarm_list != NULL) {
-        for(next = alarm_list; next != NULL; next = next->link) {
-            if(next->message_number == m_id)
-                return next;
-        }
-    }
-}
+pthread_mutex_t alarm_mutex = PTHREAD_MUTEX_INITIALIZER;
+pthread_cond_t alarm_cond = PTHREAD_COND_INITIALIZER;
+int current_alarm = 0;
 
 /*
- * Checks whether an alarm exists in the alarm list with the message
- * number of a newly received alarm request and return true or false.
+ * Period classes. Alarms that are displayed every Time seconds, at
+ * times that are the same modulo Time, share one class, and one
+ * periodic display thread displays the whole class each time it
+ * falls due; so however many alarms there are, there is one thread,
+ * and one timed wait, per period and phase in use.
+ *
+ * A class's members are kept in an array, in the order they joined,
+ * which is the order they are displayed in. due is when a member is
+ * next displayed; it is always in the class's phase, and is later
+ * than now for every member but those that have just joined.
+ * class_mutex protects the list of classes and everything in them.
+ * It may be taken before the alarm list's locks, but not after.
  */
-int message_id_exists(int m_id) {
-    alarm_t *alarm = get_alarm_at(m_id);
-
-    if (alarm != NULL)
-        return 1;
-    else
-        return 0;
-
-}
+typedef struct class_member_tag {
+    alarm_t             *alarm;
+    unsigned            generation; /* Last replacement displayed */
+    time_t              due;    /* Next display, seconds from EPOCH */
+} class_member_t;
+
+typedef struct period_class_tag {
+    struct period_class_tag *link;
+    int                 seconds; /* The period */
+    int                 phase;  /* Display times modulo seconds */
+    class_member_t      *members;
+    int                 count, size;
+    time_t              wake;   /* Time waited for, or 0 */
+    pthread_cond_t      cond;   /* Wakes the display thread */
+} period_class_t;
+
+pthread_mutex_t class_mutex = PTHREAD_MUTEX_INITIALIZER;
+period_class_t *class_list = NULL;
+
+void *periodic_display_thread(void *class_in);
 
 /*
- * If an alarm request of Type A is received and there exists an
- * alarm of Type A in the alarm list with the same message number,
- * then the old alarm is replaced by this function.
+ * Adds an alarm, held for its class, to the class for its period
+ * and the phase of due, creating the class and its display thread
+ * if there is none yet. Called with class_mutex held.
  */
-void find_and_replace(alarm_t *new_alarm) {
-    alarm_t *old_alarm;
-    int status;
-
-    sem_wait(&rw_mutex);
-
-    old_alarm = get_alarm_at(new_alarm->message_number);
-    old_alarm->seconds = new_alarm->seconds;
-    old_alarm->time = time(NULL) + new_alarm->seconds;
-    old_alarm->replaced = 1;
-    strcpy(old_alarm->message , new_alarm->message);
-
-    sem_post(&rw_mutex);
-}
-
-/*
- * Used to remove any nodes (alarm requests) from the alarm list.
- */
-void cancel_alarm (alarm_t *alarm) {
-    alarm_t *prev = alarm_list;
-
-    sem_wait(&rw_mutex);
+void class_join(alarm_t *alarm, int seconds, unsigned generation, time_t due) {
+    period_class_t *class;
+    class_member_t *members;
+    pthread_condattr_t cond_attr;
+    pthread_t display_t;
+    int phase = due % seconds, status;
 
-    if(alarm_list != NULL) {
-        if(alarm_list == alarm) {
-            if(alarm_list->link == NULL)
-                alarm_list = NULL;
-            else
-                alarm_list = alarm_list->link;
-        } else {
-            while(prev->link != NULL && prev->link != alarm)
-                prev = prev->link;
+    for(class = class_list; class != NULL; class = class->link)
+        if(class->seconds == seconds && class->phase == phase)
+            break;
+    if(class == NULL) {
+        class = (period_class_t*)calloc(1, sizeof(period_class_t));
+        if(class == NULL)
+            errno_abort("Allocate period class");
+        class->seconds = seconds;
+        class->phase = phase;
+        pthread_condattr_init(&cond_attr);
+        pthread_condattr_setclock(&cond_attr, ALARM_CLOCK_COND_ID);
+        pthread_cond_init(&class->cond, &cond_attr);
+        pthread_condattr_destroy(&cond_attr);
+        class->link = class_list;
+        class_list = class;
+        status = alarm_clock_thread_create(&display_t, NULL, periodic_display_thread, (void *)class);
+        if(status != 0)
+            err_abort(status, "Create periodic display thread");
+        status = pthread_detach(display_t);
+        if(status != 0)
+            err_abort(status, "Detach periodic display thread");
+    }
 
-            if(prev->link != NULL)
-                prev->link = prev->link->link;
-        }
+    if(class->count == class->size) {
+        class->size = class->size == 0 ? 16 : 2 * class->size;
+        members = (class_member_t*)realloc(class->members,
+            class->size * sizeof(class_member_t));
+        if(members == NULL)
+            errno_abort("Allocate period class members");
+        class->members = members;
     }
+    class->members[class->count].alarm = alarm;
+    class->members[class->count].generation = generation;
+    class->members[class->count].due = due;
+    class->count++;
 
-    sem_post(&rw_mutex);
+    /*
+     * The display thread only needs waking for a member due before
+     * the time it is waiting for; it picks up the others when it
+     * wakes anyway.
+     */
+    if(class->wake != 0 && due < class->wake) {
+        status = alarm_clock_cond_signal(&class->cond);
+        if(status != 0)
+            err_abort(status, "Signal period class");
+    }
 }
 
 /*
- * Wakes the alarm thread if it is not busy, or if a new alarm
- * arrives before the one on which the alarm thread is waiting for.
+ * Displays one member of a class that has fallen due, and says what
+ * is to become of it: 1 if it stays in the class, 0 if it has been
+ * cancelled, and so leaves the class and the alarm list, or -1 if a
+ * replacement has changed its period, and so it has moved to another
+ * class. Called with class_mutex held.
  */
-void alarm_insert(alarm_t *alarm) {
-    int status;
-    alarm_t **last, *next;
+int class_display(period_class_t *class, class_member_t *member, time_t now) {
+    alarm_t *alarm = member->alarm;
+    alarm_summary_t payload;
+    unsigned state;
 
-    sem_wait(&rw_mutex);
     /*
-     * LOCKING PROTOCOL!!!
+     * The alarm is read through the lifecycle word and the payload's
+     * sequence lock, so displaying it takes no alarm list lock and
+     * never holds writers off.
      */
-    last = &alarm_list;
-    next = *last;
-    while (next != NULL) {
-        if (next->message_number >= alarm->message_number) {
-            alarm->link = next;
-            *last = alarm;
-            break;
+    state = atomic_load(&alarm->state);
+    alarm_read_payload(alarm, &payload);
+
+    if(state & ALARM_CANCELLED) {
+        printf("Display thread exiting at <%ld>: <%d %s>\n",
+            now, payload.seconds, payload.message);
+
+        /*
+         * A cancelled alarm stays on the list, so that a second
+         * cancel request is reported as such, until its class is
+         * done with it, unless a new alarm with its number has
+         * taken its place meanwhile.
+         */
+        alarm_set_due(alarm, 0);
+        if(cancel_alarm(alarm))
+            alarm_release(alarm);
+        alarm_release(alarm);
+        return 0;
+    } else if(state & ALARM_REPLACED) {
+        if(ALARM_GENERATION(state) != member->generation) {
+            printf("Alarm With Message Number (%d) Replaced at <%ld>: <%d %s>\n",
+                payload.message_number, now, payload.seconds, payload.message);
+            member->generation = ALARM_GENERATION(state);
         }
-        last = &next->link;
-        next = next->link;
-    }
-    /*
-     * If we reached the end of the list, insert the new alarm
-     * there. ("next" is NULL, and "last" points to the link
-     * field of the last item, or to the list header.)
-     */
-    if (next == NULL) {
-        *last = alarm;
-        alarm->link = NULL;
-    }
 
-    // A.3.2.1
-    printf("First Alarm Request With Message Number (%d) Received at <%ld>: <%d %s>\n",
-        alarm->message_number, time(NULL), alarm->seconds, alarm->message);
-
-    /*
-     * Wake the alarm thread if it is not busy (that is, if
-     * current_alarm is 0, signifying that it's waiting for
-     * work), or if the new alarm comes before the one on
-     * which the alarm thread is waiting.
-     */
-    if (current_alarm == 0 || alarm->time < current_alarm) {
-        current_alarm = alarm->time;
-        status = pthread_cond_signal (&alarm_cond);
-        if (status != 0)
-            err_abort (status, "Signal cond");
+        printf("Replacement Alarm With Message Number (%d) Displayed at <%ld>: <%d %s>\n",
+            payload.message_number, now, payload.seconds, payload.message);
+    } else {
+        printf("Alarm With Message Number (%d) Displayed at <%ld>: <%d %s>\n",
+            payload.message_number, now, payload.seconds, payload.message);
     }
-
-    sem_post(&rw_mutex);
+    member->due = now + payload.seconds;
+    alarm_set_due(alarm, member->due);
+    if(payload.seconds != class->seconds) {
+        class_join(alarm, payload.seconds, member->generation, member->due);
+        return -1;
+    }
+    return 1;
 }
 
 /*
- * Responsible for, as the name suggests, periodically going
- * through the alarm list looking for Type A alarms and printing
- * the appropriate message every Time seconds, where Time is the
- * time of the alarm request originally provided when the alarm
- * request was received.
+ * Responsible for, as the name suggests, periodically displaying
+ * the alarms of one period class, every Time seconds, where Time
+ * is the time of the alarm request originally provided when the
+ * alarm request was received. A member whose period a replacement
+ * changes moves to the class of its new period; the thread exits,
+ * and frees its class, once the last member has left.
  */
-void *periodic_display_thread(void *alarm_in) {
-    int alarm_replaced = 0;
-    alarm_t *alarm = (alarm_t*) alarm_in;
-    alarm_t *next;
-    int status;
-
+void *periodic_display_thread(void *class_in) {
+    period_class_t *class = (period_class_t*) class_in;
+    period_class_t **link;
+    time_t now, next;
+    int status, kept, i;
+
+    status = pthread_mutex_lock(&class_mutex);
+    if(status != 0)
+        err_abort(status, "Lock class mutex");
     while(1) {
-        if(alarm_list != NULL) {
-            next = alarm_list;
-
-            sem_wait(&mutex);
-            read_count++;
-            if(read_count == 1)
-                sem_wait(&rw_mutex);
-            sem_post(&mutex);
-
-            while(next->message_number != alarm->message_number)
-                next = next->link;
-
-            if(next == NULL || alarm->cancellable > 0) {
-                printf("Display thread exiting at <%ld>: <%d %s>\n",
-                    time(NULL), alarm->seconds, alarm->message);
-                break;
-            } else if(next->replaced == 1) {
-                if(alarm_replaced == 0) {
-                     printf("Alarm With Message Number (%d) Replaced at <%ld>: <%d %s>\n",
-                    alarm->message_number, time(NULL), alarm->seconds, alarm->message);
-                }
-
-                printf("Replacement Alarm With Message Number (%d) Displayed at <%ld>: <%d %s>\n",
-                    next->message_number, time(NULL), next->seconds, next->message);
-                alarm_replaced = 1;
-                sleep(next->seconds);
-            } else {
-                printf("Alarm With Message Number (%d) Displayed at <%ld>: <%d %s>\n",
-                    alarm->message_number, time(NULL), alarm->seconds, alarm->message);
-                sleep(alarm->seconds);
-            }
-
-            sem_wait(&mutex);
-            read_count--;
-            if(read_count == 0)
-                sem_post(&rw_mutex);
-            sem_post(&mutex);
-
+        now = alarm_clock_time();
+        next = 0;
+        for(i = 0, kept = 0; i < class->count; i++) {
+            if(class->members[i].due <= now
+                    && class_display(class, &class->members[i], now) != 1)
+                continue;
+            if(next == 0 || class->members[i].due < next)
+                next = class->members[i].due;
+            class->members[kept++] = class->members[i];
         }
+        class->count = kept;
+        if(kept == 0)
+            break;
+
+        class->wake = next;
+        status = alarm_clock_cond_timedwait(&class->cond, &class_mutex,
+            alarm_clock_now() + (int64_t)(next - now) * 1000000000);
+        if(status != 0 && status != ETIMEDOUT)
+            err_abort(status, "Wait for period class");
+        class->wake = 0;
     }
+
+    for(link = &class_list; *link != class; link = &(*link)->link)
+        ;
+    *link = class->link;
+    status = pthread_mutex_unlock(&class_mutex);
+    if(status != 0)
+        err_abort(status, "Unlock class mutex");
+    pthread_cond_destroy(&class->cond);
+    free(class->members);
+    free(class);
+    return NULL;
 }
 
 /*
- * Tasked with actually processing each alarm request. As such,
- * it will go through the alarm list and use the get_alarm_at
- * function to fetch each alarm, and if it encounters an alarm
- * of Type A, it immediately creates a periodic display thread.
- * If it is an alarm of Type B, it uses the function cancel_alarm
- * to remove the appropriate nodes (alarm requests) from the alarm
- * list. Lastly, it will print a message to the user to let them know
- * the alarm has been processed and the time at which it was processed.
+ * Tasked with actually processing each alarm request. It waits for
+ * main to hand it a message number in current_alarm and fetches
+ * that alarm with get_alarm_at. If the alarm is not being displayed
+ * yet, it adds it to its period class, unless the alarm has been
+ * cancelled already, in which case it uses the function
+ * cancel_alarm to remove it from the alarm list. (A cancelled alarm
+ * that is being displayed is removed by its class's display thread.)
+ * Before acting it prints a message to let the user know the request
+ * has been processed, and the time at which it was processed.
  */
 void *alarm_thread(void *arg) {
-    pthread_t display_t;
     alarm_t *alarm;
-    int status;
+    alarm_summary_t payload;
+    unsigned state;
+    int m_id, status;
 
+    (void)arg;
+    status = pthread_mutex_lock (&alarm_mutex);
+    if (status != 0)
+        err_abort (status, "Lock mutex");
     while(1) {
-        if (alarm_list != NULL) {
-            alarm = get_alarm_at(current_alarm);
-
-            if(alarm->cancellable == 0){
-                status = pthread_create(&display_t, NULL, periodic_display_thread, (void *)alarm);
-                if(status != 0)
-                    err_abort(status, "Create periodic display thread");
-            } else {
-                cancel_alarm(alarm);
-            }
-            printf("Alarm Request With Message Number (%d) Processed at <%ld>: <%d %s>\n",
-                alarm->message_number, time(NULL), alarm->seconds, alarm->message);
-
-            status = pthread_cond_wait (&alarm_cond, &alarm_mutex);
+        while(current_alarm == 0) {
+            status = alarm_clock_cond_wait (&alarm_cond, &alarm_mutex);
             if (status != 0)
                 err_abort (status, "Wait on cond");
         }
+        m_id = current_alarm;
+        current_alarm = 0;
+        status = alarm_clock_cond_broadcast (&alarm_cond);
+        if (status != 0)
+            err_abort (status, "Broadcast cond");
+
+        /*
+         * Hold a reference so that the alarm outlives a display
+         * thread that removes it meanwhile.
+         */
+        reader_enter();
+        alarm = get_alarm_at(m_id);
+        if (alarm != NULL && alarm_hold(alarm) != 0)
+            alarm = NULL;
+        reader_exit();
+        if (alarm == NULL)
+            continue;
+
+        alarm_read_payload(alarm, &payload);
+        printf("Alarm Request With Message Number (%d) Processed at <%ld>: <%d %s>\n",
+            payload.message_number, alarm_clock_time(), payload.seconds, payload.message);
+
+        state = atomic_load(&alarm->state);
+        if(state & ALARM_DISPLAYING) {
+            /* Its class picks up any change by itself. */
+        } else if(state & ALARM_CANCELLED) {
+            if(cancel_alarm(alarm))
+                alarm_release(alarm);
+        } else {
+            atomic_fetch_or(&alarm->state, ALARM_DISPLAYING);
+            alarm_hold(alarm);
+            status = pthread_mutex_lock(&class_mutex);
+            if(status != 0)
+                err_abort(status, "Lock class mutex");
+            class_join(alarm, payload.seconds, 0, alarm_clock_time());
+            status = pthread_mutex_unlock(&class_mutex);
+            if(status != 0)
+                err_abort(status, "Unlock class mutex");
+        }
+        alarm_release(alarm);
     }
+}
 
+/*
+ * Hands the request for message number m_id to the alarm thread,
+ * first waiting for it to take any request still pending.
+ */
+void post_request(int m_id) {
+    int status;
+
+    status = pthread_mutex_lock (&alarm_mutex);
+    if (status != 0)
+        err_abort (status, "Lock mutex");
+    while(current_alarm != 0) {
+        status = alarm_clock_cond_wait (&alarm_cond, &alarm_mutex);
+        if (status != 0)
+            err_abort (status, "Wait on cond");
+    }
+    current_alarm = m_id;
+    status = alarm_clock_cond_broadcast (&alarm_cond);
+    if (status != 0)
+        err_abort (status, "Broadcast cond");
+    status = pthread_mutex_unlock (&alarm_mutex);
+    if (status != 0)
+        err_abort (status, "Unlock mutex");
 }
 
 /*
  * In charge of receiving each alarm request and taking appropriate
  * actions with regard to how they should be handled.
  */
-int main (int argc, char *argv[]) {
+int main (void) {
     int status;
     int cancel_message_id = 0;
+    int cancel_last_id = 0;
+    int next_count = 0;
     char line[256];
     alarm_t *alarm;
     pthread_t thread;
 
-    //semaphore init
-    sem_init(&mutex, 0, 1);
-    sem_init(&rw_mutex, 0, 1);
+    alarm_list_init();
 
-    status = pthread_create (&thread, NULL, alarm_thread, NULL);
+    status = alarm_clock_thread_create (&thread, NULL, alarm_thread, NULL);
     if (status != 0)
         err_abort (status, "Create alarm thread");
 
+#ifdef ALARM_REPLAY
+    /*
+     * Line buffered, so that the output interleaves with "Invalid
+     * command." on stderr just as it does on a terminal.
+     */
+    setvbuf(stdout, NULL, _IOLBF, 0);
+#else
         // Clear the terminal window.
         printf("\e[1;1H\e[2J");
 
@@ -306,10 +372,44 @@ int main (int argc, char *argv[]) {
         printf("Example: 2 Message(2) Hello!\n");
         printf("You may add successive alarm requests in the same format at any time during execution\n");
         printf("To cancel an alarm request, use the following format: Cancel: Message(*)\n");
+        printf("To cancel every alarm request from one message number to another: Cancel: Message(*-*)\n");
+        printf("To list the next n alarms to be displayed, use the following format: Next: n\n");
         printf("Disclaimer: Some alternate inputs will be dealt with accordingly,\n\n");
+#endif
 
     while (1) {
+#ifndef ALARM_REPLAY
         if (fgets (line, sizeof (line), stdin) == NULL) exit (0);
+#else
+        if (fgets (line, sizeof (line), stdin) == NULL) {
+            struct rusage usage;
+
+            /* Report the CPU time the scenario took. */
+            getrusage(RUSAGE_SELF, &usage);
+            fprintf(stderr, "# cpu %.3f\n",
+                usage.ru_utime.tv_sec + usage.ru_utime.tv_usec / 1e6
+                + usage.ru_stime.tv_sec + usage.ru_stime.tv_usec / 1e6);
+            exit (0);
+        }
+        if (line[0] == '#')
+            continue;
+        if (line[0] == '@') {
+            char *command;
+            long when = strtol(line + 1, &command, 10);
+
+            /*
+             * Run everything due up to t, then the command; a bare
+             * "@t" only moves the clock.
+             */
+            alarm_clock_advance((int64_t)when * 1000000000);
+            if (*command == '\n' || *command == '\0')
+                continue;
+            if (*command == ' ')
+                command++;
+            memmove(line, command, strlen(command) + 1);
+        }
+        fputs(line, stdout);
+#endif
         if (strlen (line) <= 1) continue;
         alarm = (alarm_t*)malloc (sizeof (alarm_t));
 
@@ -318,52 +418,132 @@ int main (int argc, char *argv[]) {
 
         int insert_command_parse = sscanf(line, "%d Message(%d) %128[^\n]",
             &alarm->seconds, &alarm->message_number, alarm->message);
+        int range_command_parse = sscanf(line, "Cancel: Message(%d-%d)",
+            &cancel_message_id, &cancel_last_id);
         int cancel_command_parse = sscanf(line, "Cancel: Message(%d)", &cancel_message_id);
+        int next_command_parse = sscanf(line, "Next: %d", &next_count);
 
         if(insert_command_parse == 3 && alarm->seconds > 0 && alarm->message_number > 0) {
-            // Check if the message_number exits in the alarm list
-            if(message_id_exists(alarm->message_number) == 0) {
-                alarm->time = time (NULL) + alarm->seconds;
-                alarm->cancellable = 0;
-                alarm->replaced = 0;
-                current_alarm = alarm->message_number;
-
-                status = pthread_mutex_lock (&alarm_mutex);
-                if (status != 0)
-                    err_abort (status, "Lock mutex");
-
-                /*
-                 * Insert the new alarm into the list of alarms,
-                 * sorted by message_number.
-                 */
-                alarm_insert (alarm);
-                pthread_cond_signal(&alarm_cond);
-
-                status = pthread_mutex_unlock (&alarm_mutex);
-                if (status != 0)
-                    err_abort (status, "Unlock mutex");
+            alarm->time = alarm_clock_time () + alarm->seconds;
+            atomic_init(&alarm->state, ALARM_ACTIVE);
+            atomic_init(&alarm->refs, 1);
+            seqlock_init(&alarm->payload_lock);
+            alarm->deadline.key = alarm->message_number;
+            alarm->deadline.index = -1;
+
+            /*
+             * Insert the new alarm into the list of alarms, sorted by
+             * message_number, unless the message_number exists in the
+             * list already; the test and the insert are one step, so
+             * nothing is looked at without the list's lock. The list
+             * owns the alarm from here on.
+             */
+            if(alarm_insert(alarm) == 0) {
+                // A.3.2.1
+                printf("First Alarm Request With Message Number (%d) Received at <%ld>: <%d %s>\n",
+                    alarm->message_number, alarm_clock_time(), alarm->seconds, alarm->message);
+                post_request(alarm->message_number);
             } else {
                 find_and_replace(alarm);
                 // A3.2.2 Print Statement
                 printf("Replacement Alarm Request With Message Number (%d) Received at <%ld>: <%d %s>\n",
-                    alarm->message_number, time(NULL), alarm->seconds, alarm->message);
+                    alarm->message_number, alarm_clock_time(), alarm->seconds, alarm->message);
+                post_request(alarm->message_number);
+                free(alarm);
             }
 
+        } else if(range_command_parse == 2 && cancel_message_id > cancel_last_id) {
+            printf("Error: Invalid Range of Message Numbers (%d-%d) to Cancel!\n",
+                cancel_message_id, cancel_last_id);
+            free(alarm);
+        } else if(range_command_parse == 2) {
+            alarm_t *found[ALARM_PAGE_SIZE];
+            alarm_summary_t page[ALARM_PAGE_SIZE];
+            int first = cancel_message_id, count, cancelled, total = 0, i;
+
+            /*
+             * Cancel a page of the range at a time, under one read
+             * hold each, copying the payloads of the alarms
+             * cancelled; only once the hold is released are they
+             * printed, and the alarm thread handed the page's
+             * requests, so that a slow stdout does not hold off the
+             * writers. Alarms already being cancelled are skipped.
+             */
+            do {
+                cancelled = 0;
+                reader_enter();
+                count = alarm_list_range(first, cancel_last_id,
+                    found, ALARM_PAGE_SIZE);
+                for(i = 0; i < count; i++) {
+                    if (alarm_request_cancel(found[i]) != 0)
+                        continue;
+                    alarm_read_payload(found[i], &page[cancelled++]);
+                }
+                /*
+                 * Stop after a short page or one that reaches the end
+                 * of the range; the range may end at INT_MAX, so the
+                 * test comes before adding 1 for the next page.
+                 */
+                if(count == ALARM_PAGE_SIZE
+                    && found[count - 1]->message_number < cancel_last_id)
+                    first = found[count - 1]->message_number + 1;
+                else
+                    count = 0;
+                reader_exit();
+                for(i = 0; i < cancelled; i++)
+                    printf("Cancel Alarm Request With Message Number (%d) Received at <%ld>: <%d %s>\n",
+                        page[i].message_number, alarm_clock_time(), page[i].seconds, page[i].message);
+                for(i = 0; i < cancelled; i++)
+                    post_request(page[i].message_number);
+                total += cancelled;
+            } while(count > 0);
+            if(total == 0)
+                printf("Error: No Alarm Requests With Message Numbers (%d-%d) to Cancel!\n",
+                    cancel_message_id, cancel_last_id);
+            free(alarm);
         } else if(cancel_command_parse == 1)  {
-            if(message_id_exists(cancel_message_id) == 0) {
+            alarm_t *at_alarm;
+            alarm_summary_t payload;
+            int cancelled = 0;
+
+            /*
+             * The read hold keeps the alarm thread from removing and
+             * freeing the alarm while it is looked at.
+             */
+            reader_enter();
+            at_alarm = get_alarm_at(cancel_message_id);
+            if(at_alarm == NULL) {
                 printf("Error: No Alarm Request With Message Number (%d) to Cancel!\n", cancel_message_id);
-            } else{
-                alarm_t *at_alarm = get_alarm_at(cancel_message_id);
-                if (at_alarm->cancellable > 0)
-                    printf("Error: More Than One Request to Cancel Alarm Request With Message Number (%d)!\n", cancel_message_id);
-                else {
-                    at_alarm->cancellable = at_alarm->cancellable + 1;
-                    current_alarm = at_alarm->message_number;
-                    pthread_cond_signal(&alarm_cond);
-                    printf("Cancel Alarm Request With Message Number (%d) Received at <%ld>: <%d %s>\n",
-                        at_alarm->message_number, time(NULL), at_alarm->seconds, at_alarm->message);
-                }
+            } else if (alarm_request_cancel(at_alarm) != 0) {
+                printf("Error: More Than One Request to Cancel Alarm Request With Message Number (%d)!\n", cancel_message_id);
+            } else {
+                alarm_read_payload(at_alarm, &payload);
+                printf("Cancel Alarm Request With Message Number (%d) Received at <%ld>: <%d %s>\n",
+                    payload.message_number, alarm_clock_time(), payload.seconds, payload.message);
+                cancelled = 1;
+            }
+            reader_exit();
+            if(cancelled)
+                post_request(cancel_message_id);
+            free(alarm);
+        } else if(next_command_parse == 1 && next_count > 0) {
+            alarm_due_t *due;
+            time_t now = alarm_clock_time();
+            int count, i;
+
+            count = alarm_next_due(&due, next_count);
+            if(count < 0) {
+                printf("Error: Not Enough Memory to List the Next (%d) Alarms!\n", next_count);
+                free(alarm);
+                continue;
             }
+            if(count == 0)
+                printf("No Alarms Due at <%ld>\n", now);
+            for(i = 0; i < count; i++)
+                printf("Alarm With Message Number (%d) Due at <%ld>: <%ld Seconds From Now>\n",
+                    due[i].message_number, due[i].time, due[i].time - now);
+            free(due);
+            free(alarm);
         } else {
             fprintf (stderr, "Invalid command.\n");
             free (alarm);
@@ -0,0 +1,319 @@
+/*
+ * alarm_clock.c
+ *
+ * The virtual clock (ALARM_CLOCK_VIRTUAL). The real clocks need no
+ * code beyond alarm_clock.h.
+ *
+ * Virtual time stands still until a driver thread calls
+ * alarm_clock_advance. The clock keeps track of every thread created
+ * with alarm_clock_thread_create, and knows whether each is running
+ * or blocked in one of the waits below; it only moves time on once
+ * none is running, so every thread has finished reacting to one
+ * instant before the next one comes. Timed waits end one at a time,
+ * in order of deadline and then of when they began, and the clock
+ * lets things go quiet again after each, so that a given sequence
+ * of driver calls always produces the same output.
+ *
+ * Waits on a condition variable never block on the condition
+ * variable itself. Each waiter queues a record naming it and blocks
+ * on the record, and alarm_clock_cond_signal and _broadcast wake
+ * records; a waker counts a woken thread as running before letting
+ * it go, so there is never a moment at which a thread about to run
+ * looks blocked. Every signal of a condition variable waited on
+ * through this interface must go through it too.
+ *
+ * clock_mutex protects everything here. It may be taken while
+ * holding the mutex passed to a wait, but not the other way round.
+ */
+#include <pthread.h>
+#include "errors.h"
+#include "alarm_clock.h"
+
+#if ALARM_CLOCK == ALARM_CLOCK_VIRTUAL
+
+#include "deadline_heap.h"
+
+/*
+ * A blocked thread. node must be the first field: timed waiters are
+ * found through it in the timers heap.
+ */
+typedef struct clock_waiter_tag {
+    deadline_node_t     node;   /* In timers, if timed */
+    pthread_cond_t      *cond;  /* Condition waited for, or NULL */
+    struct clock_waiter_tag *next, *prev; /* On the waiters list */
+    pthread_cond_t      wake;
+    int                 woken;
+    int                 timed_out;
+    int                 counted;
+} clock_waiter_t;
+
+atomic_llong alarm_clock_virtual;
+
+static pthread_mutex_t clock_mutex = PTHREAD_MUTEX_INITIALIZER;
+static pthread_cond_t clock_quiet = PTHREAD_COND_INITIALIZER;
+static deadline_heap_t timers;
+static int timers_ready = 0;
+static clock_waiter_t *waiters = NULL, *waiters_tail = NULL;
+static int running = 0;         /* Counted threads not blocked here */
+static int sequence = 0;        /* Orders waits with equal deadlines */
+
+/* Whether the calling thread was created by the clock. */
+static __thread int counted = 0;
+
+static void clock_lock (void)
+{
+    int status;
+
+    status = pthread_mutex_lock (&clock_mutex);
+    if (status != 0)
+        err_abort (status, "Lock clock");
+}
+
+static void clock_unlock (void)
+{
+    int status;
+
+    status = pthread_mutex_unlock (&clock_mutex);
+    if (status != 0)
+        err_abort (status, "Unlock clock");
+}
+
+static void running_done (void)
+{
+    int status;
+
+    if (--running == 0) {
+        status = pthread_cond_broadcast (&clock_quiet);
+        if (status != 0)
+            err_abort (status, "Broadcast clock quiet");
+    }
+}
+
+/*
+ * Let a waiter go, taking it off the timers heap and the waiters
+ * list. Called with clock_mutex locked.
+ */
+static void waiter_wake (clock_waiter_t *waiter, int timed_out)
+{
+    int status;
+
+    waiter->woken = 1;
+    waiter->timed_out = timed_out;
+    if (waiter->node.index >= 0)
+        deadline_heap_remove (&timers, &waiter->node);
+    if (waiter->cond != NULL) {
+        if (waiter->prev != NULL)
+            waiter->prev->next = waiter->next;
+        else
+            waiters = waiter->next;
+        if (waiter->next != NULL)
+            waiter->next->prev = waiter->prev;
+        else
+            waiters_tail = waiter->prev;
+    }
+    if (waiter->counted)
+        running++;
+    status = pthread_cond_signal (&waiter->wake);
+    if (status != 0)
+        err_abort (status, "Signal clock waiter");
+}
+
+/*
+ * Block until cond is signalled (if cond is not NULL) or virtual
+ * time reaches when (if timed), releasing mutex (if not NULL) while
+ * blocked, as pthread_cond_timedwait does.
+ */
+static int clock_wait (pthread_cond_t *cond, pthread_mutex_t *mutex,
+    int64_t when, int timed)
+{
+    clock_waiter_t waiter;
+    int status;
+
+    clock_lock ();
+    if (timed && when <= alarm_clock_now ()) {
+        clock_unlock ();
+        return ETIMEDOUT;
+    }
+    if (!timers_ready) {
+        status = deadline_heap_init (&timers, 64);
+        if (status != 0)
+            err_abort (status, "Initialize clock timers");
+        timers_ready = 1;
+    }
+
+    waiter.node.index = -1;
+    waiter.cond = cond;
+    waiter.woken = 0;
+    waiter.timed_out = 0;
+    waiter.counted = counted;
+    pthread_cond_init (&waiter.wake, NULL);
+    if (cond != NULL) {
+        waiter.next = NULL;
+        waiter.prev = waiters_tail;
+        if (waiters_tail != NULL)
+            waiters_tail->next = &waiter;
+        else
+            waiters = &waiter;
+        waiters_tail = &waiter;
+    }
+    if (timed) {
+        waiter.node.deadline = when;
+        waiter.node.key = sequence++;
+        status = deadline_heap_push (&timers, &waiter.node);
+        if (status != 0)
+            err_abort (status, "Queue clock timer");
+    }
+    if (counted)
+        running_done ();
+    if (mutex != NULL) {
+        status = pthread_mutex_unlock (mutex);
+        if (status != 0)
+            err_abort (status, "Unlock for clock wait");
+    }
+
+    while (!waiter.woken) {
+        status = pthread_cond_wait (&waiter.wake, &clock_mutex);
+        if (status != 0)
+            err_abort (status, "Wait for clock");
+    }
+    clock_unlock ();
+    pthread_cond_destroy (&waiter.wake);
+
+    if (mutex != NULL) {
+        status = pthread_mutex_lock (mutex);
+        if (status != 0)
+            err_abort (status, "Relock after clock wait");
+    }
+    return waiter.timed_out ? ETIMEDOUT : 0;
+}
+
+void alarm_clock_sleep (int seconds)
+{
+    clock_wait (NULL, NULL,
+        alarm_clock_now () + (int64_t)seconds * 1000000000, 1);
+}
+
+int alarm_clock_cond_timedwait (
+    pthread_cond_t *cond, pthread_mutex_t *mutex, int64_t when)
+{
+    return clock_wait (cond, mutex, when, 1);
+}
+
+int alarm_clock_cond_wait (pthread_cond_t *cond, pthread_mutex_t *mutex)
+{
+    return clock_wait (cond, mutex, 0, 0);
+}
+
+/*
+ * Wake the longest waiting thread on cond, or all of them.
+ */
+static int clock_signal (pthread_cond_t *cond, int all)
+{
+    clock_waiter_t *waiter, *next;
+
+    clock_lock ();
+    for (waiter = waiters; waiter != NULL; waiter = next) {
+        next = waiter->next;
+        if (waiter->cond == cond) {
+            waiter_wake (waiter, 0);
+            if (!all)
+                break;
+        }
+    }
+    clock_unlock ();
+    return 0;
+}
+
+int alarm_clock_cond_signal (pthread_cond_t *cond)
+{
+    return clock_signal (cond, 0);
+}
+
+int alarm_clock_cond_broadcast (pthread_cond_t *cond)
+{
+    return clock_signal (cond, 1);
+}
+
+typedef struct clock_start_tag {
+    void                *(*routine)(void*);
+    void                *arg;
+} clock_start_t;
+
+static void *clock_thread_start (void *arg)
+{
+    clock_start_t start = *(clock_start_t*)arg;
+    void *result;
+
+    free (arg);
+    counted = 1;
+    result = start.routine (start.arg);
+    counted = 0;
+    clock_lock ();
+    running_done ();
+    clock_unlock ();
+    return result;
+}
+
+/*
+ * pthread_create for threads the clock waits for. The new thread
+ * counts as running from before it exists until its start routine
+ * returns.
+ */
+int alarm_clock_thread_create (pthread_t *thread,
+    const pthread_attr_t *attr, void *(*routine)(void*), void *arg)
+{
+    clock_start_t *start;
+    int status;
+
+    start = (clock_start_t*)malloc (sizeof (clock_start_t));
+    if (start == NULL)
+        return ENOMEM;
+    start->routine = routine;
+    start->arg = arg;
+
+    clock_lock ();
+    running++;
+    clock_unlock ();
+    status = pthread_create (thread, attr, clock_thread_start, start);
+    if (status != 0) {
+        clock_lock ();
+        running_done ();
+        clock_unlock ();
+        free (start);
+    }
+    return status;
+}
+
+/*
+ * Move virtual time on to when, ending each timed wait due by then
+ * in turn and letting every counted thread finish what that sets
+ * off before the next. Returns with all counted threads blocked and
+ * the clock at when (or later, if another driver got there first).
+ * Must not be called by a counted thread, which would wait for
+ * itself.
+ */
+void alarm_clock_advance (int64_t when)
+{
+    deadline_node_t *node;
+    int status;
+
+    clock_lock ();
+    while (1) {
+        while (running > 0) {
+            status = pthread_cond_wait (&clock_quiet, &clock_mutex);
+            if (status != 0)
+                err_abort (status, "Wait for clock quiet");
+        }
+        node = timers_ready ? deadline_heap_peek (&timers) : NULL;
+        if (node == NULL || node->deadline > when)
+            break;
+        if (node->deadline > alarm_clock_now ())
+            atomic_store (&alarm_clock_virtual, node->deadline);
+        waiter_wake ((clock_waiter_t*)node, 1);
+    }
+    if (when > alarm_clock_now ())
+        atomic_store (&alarm_clock_virtual, when);
+    clock_unlock ();
+}
+
+#endif
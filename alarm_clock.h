@@ -0,0 +1,110 @@
+#ifndef __alarm_clock_h
+#define __alarm_clock_h
+
+#include <pthread.h>
+#include <stdint.h>
+#include <time.h>
+#include <unistd.h>
+#include "alarm_config.h"
+
+/*
+ * The engine's clock, selected by ALARM_CLOCK. ALARM_CLOCK_ID is
+ * what alarm_clock_now reads; ALARM_CLOCK_COND_ID is the clock
+ * condition variable timeouts are measured on, which has to be the
+ * same time base but cannot be a coarse clock.
+ *
+ * Everything that reads the time, sleeps, or waits on a condition
+ * variable that a timeout or another clock-aware thread may end
+ * goes through the functions here, so that the virtual clock can
+ * stand in for all of them (see alarm_clock.c). With a real clock
+ * they are the plain POSIX calls.
+ */
+#if ALARM_CLOCK == ALARM_CLOCK_MONOTONIC
+# define ALARM_CLOCK_ID         CLOCK_MONOTONIC
+# define ALARM_CLOCK_COND_ID    CLOCK_MONOTONIC
+#elif ALARM_CLOCK == ALARM_CLOCK_COARSE
+# define ALARM_CLOCK_ID         CLOCK_MONOTONIC_COARSE
+# define ALARM_CLOCK_COND_ID    CLOCK_MONOTONIC
+#elif ALARM_CLOCK == ALARM_CLOCK_REALTIME
+# define ALARM_CLOCK_ID         CLOCK_REALTIME
+# define ALARM_CLOCK_COND_ID    CLOCK_REALTIME
+#else
+# define ALARM_CLOCK_COND_ID    CLOCK_MONOTONIC /* Unused */
+#endif
+
+static inline void alarm_clock_timespec (int64_t when, struct timespec *ts)
+{
+    ts->tv_sec = when / 1000000000;
+    ts->tv_nsec = when % 1000000000;
+}
+
+#if ALARM_CLOCK != ALARM_CLOCK_VIRTUAL
+
+/* Nanoseconds on the configured clock. */
+static inline int64_t alarm_clock_now (void)
+{
+    struct timespec now;
+
+    clock_gettime (ALARM_CLOCK_ID, &now);
+    return (int64_t)now.tv_sec * 1000000000 + now.tv_nsec;
+}
+
+/* Seconds from EPOCH, for New_Alarm_Cond's messages. */
+static inline time_t alarm_clock_time (void)
+{
+    return time (NULL);
+}
+
+static inline void alarm_clock_sleep (int seconds)
+{
+    sleep (seconds);
+}
+
+/*
+ * Wait on cond until when, in nanoseconds on the configured clock.
+ * cond must have been initialized with ALARM_CLOCK_COND_ID.
+ */
+static inline int alarm_clock_cond_timedwait (
+    pthread_cond_t *cond, pthread_mutex_t *mutex, int64_t when)
+{
+    struct timespec ts;
+
+    alarm_clock_timespec (when, &ts);
+    return pthread_cond_timedwait (cond, mutex, &ts);
+}
+
+# define alarm_clock_cond_wait          pthread_cond_wait
+# define alarm_clock_cond_signal        pthread_cond_signal
+# define alarm_clock_cond_broadcast     pthread_cond_broadcast
+# define alarm_clock_thread_create      pthread_create
+
+#else
+
+#include <stdatomic.h>
+
+extern atomic_llong alarm_clock_virtual;
+
+static inline int64_t alarm_clock_now (void)
+{
+    return atomic_load (&alarm_clock_virtual);
+}
+
+static inline time_t alarm_clock_time (void)
+{
+    return (time_t)(alarm_clock_now () / 1000000000);
+}
+
+extern void alarm_clock_sleep (int seconds);
+extern int alarm_clock_cond_timedwait (
+    pthread_cond_t *cond, pthread_mutex_t *mutex, int64_t when);
+extern int alarm_clock_cond_wait (
+    pthread_cond_t *cond, pthread_mutex_t *mutex);
+extern int alarm_clock_cond_signal (pthread_cond_t *cond);
+extern int alarm_clock_cond_broadcast (pthread_cond_t *cond);
+extern int alarm_clock_thread_create (pthread_t *thread,
+    const pthread_attr_t *attr, void *(*routine)(void*), void *arg);
+extern void alarm_clock_advance (int64_t when);
+
+#endif
+
+#endif
@@ -0,0 +1,154 @@
+#ifndef __alarm_config_h
+#define __alarm_config_h
+
+/*
+ * Compile-time configuration of the alarm engine. Each component
+ * is chosen with a -D flag (the Makefile sets them from its QUEUE,
+ * LOCK, CLOCK and SINK variables), and only the chosen
+ * implementation is compiled in, so the engine never tests which
+ * one it is using.
+ *
+ * ALARM_QUEUE  The deadline queue the dispatcher takes alarms from:
+ *              a sorted list, a binary heap, a timing wheel, a
+ *              radix heap, or a wheel for the next few seconds in
+ *              front of a heap for everything later.
+ * ALARM_LOCK   How queries are kept apart from changes to the queue:
+ *              the semaphore readers/writer protocol New_Alarm_Cond.c
+ *              started with, a pthread rwlock, or the big-reader
+ *              lock New_Alarm_Cond.c uses now (brlock.h).
+ * ALARM_CLOCK  The clock deadlines are measured on, or a virtual
+ *              clock that only moves when a driver advances it, for
+ *              running long schedules in no time (see alarm_clock.h).
+ * ALARM_SINK   Where output lines go: straight to stdout a line at a
+ *              time, through a large per-thread buffer, or nowhere.
+ *
+ * ALARM_INDEX is not the engine's but New_Alarm_Cond.c's: whether
+ * its alarm list (alarm_list.c) is a linked list under list_lock,
+ * a lock-free skip list that many threads can change at once
+ * (skiplist.h), or a B+-tree under list_lock whose nodes are cache
+ * lines (btree.h). The Makefile sets it from INDEX. Under list_lock,
+ * ALARM_LIST_COMBINE (1 by default) has writers hand their changes
+ * to whichever of them holds the lock, rather than each taking it
+ * in turn; 0 turns that off, for comparison.
+ */
+#define ALARM_QUEUE_LIST        1
+#define ALARM_QUEUE_HEAP        2
+#define ALARM_QUEUE_WHEEL       3
+#define ALARM_QUEUE_RADIX       4
+#define ALARM_QUEUE_HYBRID      5
+
+#define ALARM_LOCK_SEM          1
+#define ALARM_LOCK_RWLOCK       2
+#define ALARM_LOCK_BRLOCK       3
+
+#define ALARM_CLOCK_MONOTONIC   1
+#define ALARM_CLOCK_COARSE      2
+#define ALARM_CLOCK_REALTIME    3
+#define ALARM_CLOCK_VIRTUAL     4
+
+#define ALARM_SINK_STDOUT       1
+#define ALARM_SINK_BUFFER       2
+#define ALARM_SINK_NULL         3
+
+#define ALARM_INDEX_LIST        1
+#define ALARM_INDEX_SKIPLIST    2
+#define ALARM_INDEX_BTREE       3
+
+#ifndef ALARM_QUEUE
+# define ALARM_QUEUE            ALARM_QUEUE_HEAP
+#endif
+#ifndef ALARM_LOCK
+# define ALARM_LOCK             ALARM_LOCK_SEM
+#endif
+#ifndef ALARM_CLOCK
+# define ALARM_CLOCK            ALARM_CLOCK_MONOTONIC
+#endif
+#ifndef ALARM_SINK
+# define ALARM_SINK             ALARM_SINK_STDOUT
+#endif
+#ifndef ALARM_INDEX
+# define ALARM_INDEX            ALARM_INDEX_LIST
+#endif
+#ifndef ALARM_LIST_COMBINE
+# define ALARM_LIST_COMBINE     1
+#endif
+
+#if ALARM_QUEUE < ALARM_QUEUE_LIST || ALARM_QUEUE > ALARM_QUEUE_HYBRID
+# error "ALARM_QUEUE must be ALARM_QUEUE_LIST, _HEAP, _WHEEL, _RADIX or _HYBRID"
+#endif
+#if ALARM_LOCK < ALARM_LOCK_SEM || ALARM_LOCK > ALARM_LOCK_BRLOCK
+# error "ALARM_LOCK must be ALARM_LOCK_SEM, _RWLOCK or _BRLOCK"
+#endif
+#if ALARM_CLOCK < ALARM_CLOCK_MONOTONIC || ALARM_CLOCK > ALARM_CLOCK_VIRTUAL
+# error "ALARM_CLOCK must be ALARM_CLOCK_MONOTONIC, _COARSE, _REALTIME or _VIRTUAL"
+#endif
+#if ALARM_SINK < ALARM_SINK_STDOUT || ALARM_SINK > ALARM_SINK_NULL
+# error "ALARM_SINK must be ALARM_SINK_STDOUT, _BUFFER or _NULL"
+#endif
+#if ALARM_INDEX < ALARM_INDEX_LIST || ALARM_INDEX > ALARM_INDEX_BTREE
+# error "ALARM_INDEX must be ALARM_INDEX_LIST, _SKIPLIST or _BTREE"
+#endif
+
+/*
+ * The names the Makefile uses for each choice, for reports.
+ */
+#if ALARM_QUEUE == ALARM_QUEUE_LIST
+# define ALARM_QUEUE_NAME       "list"
+#elif ALARM_QUEUE == ALARM_QUEUE_HEAP
+# define ALARM_QUEUE_NAME       "heap"
+#elif ALARM_QUEUE == ALARM_QUEUE_WHEEL
+# define ALARM_QUEUE_NAME       "wheel"
+#elif ALARM_QUEUE == ALARM_QUEUE_RADIX
+# define ALARM_QUEUE_NAME       "radix"
+#else
+# define ALARM_QUEUE_NAME       "hybrid"
+#endif
+#if ALARM_LOCK == ALARM_LOCK_SEM
+# define ALARM_LOCK_NAME        "sem"
+#elif ALARM_LOCK == ALARM_LOCK_RWLOCK
+# define ALARM_LOCK_NAME        "rwlock"
+#else
+# define ALARM_LOCK_NAME        "brlock"
+#endif
+#if ALARM_CLOCK == ALARM_CLOCK_MONOTONIC
+# define ALARM_CLOCK_NAME       "monotonic"
+#elif ALARM_CLOCK == ALARM_CLOCK_COARSE
+# define ALARM_CLOCK_NAME       "coarse"
+#elif ALARM_CLOCK == ALARM_CLOCK_REALTIME
+# define ALARM_CLOCK_NAME       "realtime"
+#else
+# define ALARM_CLOCK_NAME       "virtual"
+#endif
+#if ALARM_SINK == ALARM_SINK_STDOUT
+# define ALARM_SINK_NAME        "stdout"
+#elif ALARM_SINK == ALARM_SINK_BUFFER
+# define ALARM_SINK_NAME        "buffer"
+#else
+# define ALARM_SINK_NAME        "null"
+#endif
+#if ALARM_INDEX == ALARM_INDEX_LIST
+# define ALARM_INDEX_NAME       "list"
+#elif ALARM_INDEX == ALARM_INDEX_SKIPLIST
+# define ALARM_INDEX_NAME       "skiplist"
+#else
+# define ALARM_INDEX_NAME       "btree"
+#endif
+#define ALARM_VARIANT_NAME \
+    ALARM_QUEUE_NAME "-" ALARM_LOCK_NAME "-" ALARM_CLOCK_NAME "-" ALARM_SINK_NAME
+
+/*
+ * Timing wheel geometry: ALARM_WHEEL_SLOTS slots (a power of two)
+ * of ALARM_WHEEL_TICK nanoseconds each. The hybrid queue's wheel
+ * has the same, so by default it covers the next 4 seconds.
+ */
+#ifndef ALARM_WHEEL_TICK
+# define ALARM_WHEEL_TICK       1000000
+#endif
+#ifndef ALARM_WHEEL_SLOTS
+# define ALARM_WHEEL_SLOTS      4096
+#endif
+#if ALARM_WHEEL_SLOTS < 64 || (ALARM_WHEEL_SLOTS & (ALARM_WHEEL_SLOTS - 1)) != 0
+# error "ALARM_WHEEL_SLOTS must be a power of two, at least 64"
+#endif
+
+#endif
@@ -0,0 +1,1284 @@
+/*
+ * alarm_engine.c
+ *
+ * The alarm engine; see alarm_engine.h.
+ *
+ * LOCKING PROTOCOL:
+ *
+ * The deadline queue, the message number table, the entry pool and
+ * the state of every entry are protected by the engine's
+ * readers/writer lock (alarm_lock.h). Only alarm_engine_next reads
+ * under it; everything else, the dispatcher included, writes.
+ *
+ * The engine mutex protects only what the dispatcher sleeps on:
+ * current, wakeups and fired_count. It may be taken while holding
+ * the readers/writer lock, but not the other way round.
+ *
+ * With workers, the dispatcher hands due entries over on the ready
+ * ring, protected by work_mutex, and a worker runs the callback.
+ * When batching, it hands them over as chunks of the batch array
+ * instead, also under work_mutex. work_mutex is never held while
+ * taking another lock. It also protects the pool itself: the count
+ * of workers, and of those idle, which an elastic pool grows and
+ * shrinks by.
+ *
+ * A busy-polling dispatcher never sleeps on the engine mutex, so
+ * instead of signalling it, writers bump poll_changes, which it
+ * reads without a lock between looks at the queue.
+ */
+#ifdef __linux__
+# define _GNU_SOURCE    /* For pthread_attr_setaffinity_np */
+#endif
+#include <pthread.h>
+#include <sched.h>
+#include <stdatomic.h>
+#include <sys/mman.h>
+#include <time.h>
+#include <unistd.h>
+#include "errors.h"
+#include "alarm_engine.h"
+#include "alarm_clock.h"
+#include "alarm_lock.h"
+#include "alarm_queue.h"
+#include "alarm_sink.h"
+#include "tsc.h"
+
+/*
+ * Entry states. An entry is FREE in the pool, RESERVED between
+ * alarm_engine_alloc and alarm_engine_schedule, QUEUED in the
+ * queue, FIRING once it has been taken off the queue to fire (on
+ * the ready ring, or in a batch), STARTED while its callback runs,
+ * and CANCELLED if it was cancelled after it was taken. An entry
+ * cancelled before its callback started is out of the table at
+ * once, and whoever was to run the callback frees it instead; one
+ * cancelled while its callback ran stays in the table until whoever
+ * ran the callback frees it, when the callback returns.
+ */
+#define ENTRY_FREE      0
+#define ENTRY_RESERVED  1
+#define ENTRY_QUEUED    2
+#define ENTRY_FIRING    3
+#define ENTRY_STARTED   4
+#define ENTRY_CANCELLED 5
+
+struct alarm_engine_tag {
+    alarm_lock_t        lock;
+    alarm_queue_t       queue;
+    alarm_entry_t       *entries; /* The pool */
+    alarm_entry_t       *free_list;
+    alarm_entry_t       **table; /* Scheduled entries by number */
+    int                 table_size;
+    pthread_mutex_t     mutex;
+    pthread_cond_t      cond;   /* Wakes the dispatcher */
+    pthread_cond_t      fired;  /* Broadcast after each callback */
+    pthread_t           dispatcher;
+    int64_t             current; /* Deadline being waited for, or 0 */
+    unsigned long       wakeups; /* Changes since the dispatcher looked */
+    unsigned long       fired_count;
+    int                 shutdown;
+    pthread_mutex_t     work_mutex;
+    pthread_cond_t      work_cond; /* Wakes the workers */
+    pthread_cond_t      work_exit; /* Broadcast when none is left */
+    pthread_attr_t      worker_attr;
+    pthread_attr_t      *worker_attr_p; /* &worker_attr, or NULL */
+    int                 worker_count; /* Started, or being started */
+    int                 worker_min, worker_max; /* Equal unless elastic */
+    int                 worker_idle; /* Waiting for work */
+    int                 worker_growing; /* A worker is being started */
+    pthread_t           worker_exited; /* The last to exit, unjoined */
+    int                 worker_unjoined;
+    alarm_entry_t       **ready; /* Ring of due entries for workers */
+    int                 ready_size, ready_head, ready_count;
+    int                 workers_stop;
+    alarm_entry_t       **batch; /* Entries due at once, in order */
+    int                 batch_count;
+    int                 batch_chunk; /* Entries a chunk, or 0 */
+    alarm_sink_capture_t *captures; /* Output of each chunk */
+    int                 chunk_max; /* Chunks in a batch of every entry */
+    char                *chunk_ready; /* Chunks fired, not written */
+    int                 chunk_count, chunk_next, chunk_emit;
+    int                 emitting; /* A thread is writing chunks out */
+    pthread_cond_t      batch_cond; /* Broadcast when a batch is out */
+    int                 busy_poll; /* The dispatcher polls */
+    atomic_ulong        poll_changes; /* Queue changes, when polling */
+    atomic_int          poll_stop;
+    int64_t             spin_limit; /* Longest early wake, or 0 */
+    int64_t             wake_mean; /* Timed wait overshoot, x8 */
+    int64_t             wake_dev; /* Its mean deviation, x4 */
+};
+
+/* The entry whose callback the calling thread is running, if any. */
+static __thread alarm_entry_t *firing_entry;
+
+int64_t alarm_engine_now (void)
+{
+    return alarm_clock_now ();
+}
+
+static alarm_entry_t **table_slot (alarm_engine_t *engine, int number)
+{
+    alarm_entry_t **slot;
+
+    slot = &engine->table[(unsigned)number % engine->table_size];
+    while (*slot != NULL && alarm_entry_id (*slot) != number)
+        slot = &(*slot)->link;
+    return slot;
+}
+
+static void table_remove (alarm_engine_t *engine, alarm_entry_t *entry)
+{
+    alarm_entry_t **slot = table_slot (engine, alarm_entry_id (entry));
+
+    *slot = entry->link;
+}
+
+/*
+ * Return an entry to the pool. The caller holds the write lock, and
+ * has already taken the entry out of the queue and the table.
+ */
+static void entry_release (alarm_engine_t *engine, alarm_entry_t *entry)
+{
+    if (entry->drop != NULL)
+        entry->drop (entry->payload.bytes);
+    entry->state = ENTRY_FREE;
+    entry->generation++;
+    entry->link = engine->free_list;
+    engine->free_list = entry;
+}
+
+static void engine_lock (alarm_engine_t *engine)
+{
+    int status = pthread_mutex_lock (&engine->mutex);
+
+    if (status != 0)
+        err_abort (status, "Lock engine");
+}
+
+static void engine_unlock (alarm_engine_t *engine)
+{
+    int status = pthread_mutex_unlock (&engine->mutex);
+
+    if (status != 0)
+        err_abort (status, "Unlock engine");
+}
+
+/*
+ * Mark an entry that was taken off the queue (FIRING) as STARTED,
+ * just before its callback is run. Returns 1, or 0 if the entry was
+ * cancelled meanwhile, in which case it goes back to the pool and
+ * its callback must not be run.
+ */
+static int entry_start (alarm_engine_t *engine, alarm_entry_t *entry)
+{
+    int started = 1;
+
+    alarm_lock_write (&engine->lock);
+    if (entry->state == ENTRY_CANCELLED) {
+        entry_release (engine, entry);
+        started = 0;
+    } else
+        entry->state = ENTRY_STARTED;
+    alarm_lock_write_done (&engine->lock);
+    return started;
+}
+
+/*
+ * Run an entry's callback, then requeue the entry if it is periodic
+ * and still wanted, or give it back to the pool. Called by the
+ * dispatcher, or by a worker, for an entry it has taken off the
+ * queue and marked STARTED.
+ */
+static void entry_fire (alarm_engine_t *engine, alarm_entry_t *entry)
+{
+    int64_t requeued = 0;
+    int status;
+
+    firing_entry = entry;
+    entry->fire (entry, entry->payload.bytes);
+    firing_entry = NULL;
+
+    alarm_lock_write (&engine->lock);
+    if (entry->state == ENTRY_CANCELLED || entry->period == 0) {
+        table_remove (engine, entry);
+        entry_release (engine, entry);
+    } else {
+        /*
+         * Periodic alarms keep a fixed rate: the next deadline is a
+         * period after the last one, not after now.
+         */
+        entry->state = ENTRY_QUEUED;
+        entry->deadline.deadline += entry->period;
+        status = alarm_queue_push (&engine->queue, &entry->deadline);
+        if (status != 0)
+            err_abort (status, "Requeue alarm");
+        requeued = entry->deadline.deadline;
+    }
+    alarm_lock_write_done (&engine->lock);
+
+    if (requeued != 0 && engine->busy_poll)
+        atomic_fetch_add (&engine->poll_changes, 1);
+    engine_lock (engine);
+    engine->fired_count++;
+    status = alarm_clock_cond_broadcast (&engine->fired);
+    if (status != 0)
+        err_abort (status, "Broadcast fired");
+    if (requeued != 0 && !engine->busy_poll) {
+        engine->wakeups++;
+        if (engine->current == 0 || requeued < engine->current) {
+            status = alarm_clock_cond_signal (&engine->cond);
+            if (status != 0)
+                err_abort (status, "Signal engine");
+        }
+    }
+    engine_unlock (engine);
+}
+
+/*
+ * Write out the chunks of the batch that are fired, in order, from
+ * the first not yet written until one that is not fired yet. Called
+ * with work_mutex held, by whoever fires a chunk while no one else
+ * is writing; chunks fired meanwhile are picked up on the way.
+ */
+static void batch_emit (alarm_engine_t *engine)
+{
+    alarm_sink_capture_t *capture;
+    int status;
+
+    engine->emitting = 1;
+    while (engine->chunk_emit < engine->chunk_count
+            && engine->chunk_ready[engine->chunk_emit]) {
+        capture = &engine->captures[engine->chunk_emit];
+        status = pthread_mutex_unlock (&engine->work_mutex);
+        if (status != 0)
+            err_abort (status, "Unlock work");
+        if (capture->length > 0) {
+            alarm_sink_write (capture->data, capture->length);
+            alarm_sink_flush ();
+        }
+        status = pthread_mutex_lock (&engine->work_mutex);
+        if (status != 0)
+            err_abort (status, "Lock work");
+        engine->chunk_emit++;
+    }
+    engine->emitting = 0;
+    if (engine->chunk_emit == engine->chunk_count) {
+        status = pthread_cond_broadcast (&engine->batch_cond);
+        if (status != 0)
+            err_abort (status, "Broadcast batch");
+    }
+}
+
+/*
+ * Claim and fire chunks of the batch until none is left, capturing
+ * each chunk's output for batch_emit. Called, and returns, with
+ * work_mutex held.
+ */
+static void batch_work (alarm_engine_t *engine)
+{
+    int chunk, first, last, status;
+
+    while (engine->chunk_next < engine->chunk_count) {
+        chunk = engine->chunk_next++;
+        status = pthread_mutex_unlock (&engine->work_mutex);
+        if (status != 0)
+            err_abort (status, "Unlock work");
+
+        first = chunk * engine->batch_chunk;
+        last = first + engine->batch_chunk;
+        if (last > engine->batch_count)
+            last = engine->batch_count;
+        engine->captures[chunk].length = 0;
+        alarm_sink_capture (&engine->captures[chunk]);
+        for (; first < last; first++)
+            if (entry_start (engine, engine->batch[first]))
+                entry_fire (engine, engine->batch[first]);
+        alarm_sink_capture (NULL);
+
+        status = pthread_mutex_lock (&engine->work_mutex);
+        if (status != 0)
+            err_abort (status, "Lock work");
+        engine->chunk_ready[chunk] = 1;
+        if (!engine->emitting)
+            batch_emit (engine);
+    }
+}
+
+static void *worker_routine (void *arg);
+
+/*
+ * Start another worker, if the pool is elastic and not yet at its
+ * limit, and no other is being started. Called, and returns, with
+ * work_mutex held; it is released while the thread is created.
+ */
+static void worker_grow (alarm_engine_t *engine)
+{
+    pthread_t thread;
+    int created, status;
+
+    if (engine->worker_count >= engine->worker_max || engine->worker_growing)
+        return;
+    engine->worker_growing = 1;
+    engine->worker_count++;
+    status = pthread_mutex_unlock (&engine->work_mutex);
+    if (status != 0)
+        err_abort (status, "Unlock work");
+    created = alarm_clock_thread_create (
+        &thread, engine->worker_attr_p, worker_routine, engine);
+    status = pthread_mutex_lock (&engine->work_mutex);
+    if (status != 0)
+        err_abort (status, "Lock work");
+    engine->worker_growing = 0;
+    /* Without it, make do with the workers there are. */
+    if (created != 0 && --engine->worker_count == 0) {
+        status = alarm_clock_cond_broadcast (&engine->work_exit);
+        if (status != 0)
+            err_abort (status, "Broadcast work exit");
+    }
+}
+
+/*
+ * The calling worker leaves the pool. Every worker that exits joins
+ * the one that exited before it, once it has let go of work_mutex,
+ * and the last is joined by workers_stop, so that none is left
+ * unjoined however many come and go. Called with work_mutex held,
+ * which it releases.
+ */
+static void worker_exit (alarm_engine_t *engine)
+{
+    pthread_t previous = engine->worker_exited;
+    int unjoined = engine->worker_unjoined, status;
+
+    engine->worker_exited = pthread_self ();
+    engine->worker_unjoined = 1;
+    if (--engine->worker_count == 0) {
+        status = alarm_clock_cond_broadcast (&engine->work_exit);
+        if (status != 0)
+            err_abort (status, "Broadcast work exit");
+    }
+    status = pthread_mutex_unlock (&engine->work_mutex);
+    if (status != 0)
+        err_abort (status, "Unlock work");
+    if (unjoined)
+        pthread_join (previous, NULL);
+}
+
+/*
+ * A worker's start routine: run the callbacks of the entries the
+ * dispatcher puts on the ready ring, in the order they fell due, or
+ * help fire the chunks of a batch. In an elastic pool, a worker
+ * beyond the first workers leaves after ALARM_ENGINE_IDLE with
+ * nothing to do, and one that takes an entry late with none of the
+ * others idle starts another.
+ */
+static void *worker_routine (void *arg)
+{
+    alarm_engine_t *engine = (alarm_engine_t*)arg;
+    alarm_entry_t *entry;
+    int status;
+
+    status = pthread_mutex_lock (&engine->work_mutex);
+    if (status != 0)
+        err_abort (status, "Lock work");
+    while (1) {
+        while (engine->ready_count == 0
+                && engine->chunk_next == engine->chunk_count
+                && !engine->workers_stop) {
+            engine->worker_idle++;
+            if (engine->worker_count > engine->worker_min)
+                status = alarm_clock_cond_timedwait (&engine->work_cond,
+                    &engine->work_mutex, alarm_clock_now () + ALARM_ENGINE_IDLE);
+            else
+                status = alarm_clock_cond_wait (
+                    &engine->work_cond, &engine->work_mutex);
+            engine->worker_idle--;
+            if (status == ETIMEDOUT)
+                break;
+            if (status != 0)
+                err_abort (status, "Wait for work");
+        }
+        if (engine->workers_stop)
+            break;
+        if (engine->chunk_next < engine->chunk_count) {
+            batch_work (engine);
+            continue;
+        }
+        if (engine->ready_count == 0) {
+            if (engine->worker_count > engine->worker_min)
+                break;
+            continue;
+        }
+        entry = engine->ready[engine->ready_head];
+        engine->ready_head = (engine->ready_head + 1) % engine->ready_size;
+        engine->ready_count--;
+        if (engine->worker_idle == 0 && alarm_clock_now ()
+                - alarm_entry_deadline (entry) > ALARM_ENGINE_LATE)
+            worker_grow (engine);
+        status = pthread_mutex_unlock (&engine->work_mutex);
+        if (status != 0)
+            err_abort (status, "Unlock work");
+
+        if (entry_start (engine, entry))
+            entry_fire (engine, entry);
+
+        status = pthread_mutex_lock (&engine->work_mutex);
+        if (status != 0)
+            err_abort (status, "Lock work");
+    }
+    worker_exit (engine);
+    return NULL;
+}
+
+/*
+ * Put a due entry on the ready ring for the workers. The ring has
+ * room for every entry in the pool, so it cannot overflow. If there
+ * are more entries waiting than idle workers, an elastic pool grows.
+ * Returns 0, or -1 (and leaves the entry the caller's, to fire
+ * itself) if there is no worker at all and none could be started.
+ */
+static int ready_push (alarm_engine_t *engine, alarm_entry_t *entry)
+{
+    int status, pushed = 0;
+
+    status = pthread_mutex_lock (&engine->work_mutex);
+    if (status != 0)
+        err_abort (status, "Lock work");
+    engine->ready[(engine->ready_head + engine->ready_count)
+        % engine->ready_size] = entry;
+    engine->ready_count++;
+    status = alarm_clock_cond_signal (&engine->work_cond);
+    if (status != 0)
+        err_abort (status, "Signal work");
+    if (engine->ready_count > engine->worker_idle)
+        worker_grow (engine);
+    if (engine->worker_count == 0) {
+        engine->ready_count--;
+        pushed = -1;
+    }
+    status = pthread_mutex_unlock (&engine->work_mutex);
+    if (status != 0)
+        err_abort (status, "Unlock work");
+    return pushed;
+}
+
+/*
+ * Fire the count entries of a batch. With workers, and more than one
+ * chunk's worth, the chunks are put up for the workers, and the
+ * dispatcher fires them alongside until none is left and then waits
+ * for the last to be written out; otherwise it fires them all
+ * itself, in order, with nothing to put back in order.
+ */
+static void batch_fire (alarm_engine_t *engine, int count)
+{
+    int status, i;
+
+    if (engine->worker_max == 0 || count <= engine->batch_chunk) {
+        for (i = 0; i < count; i++)
+            if (entry_start (engine, engine->batch[i]))
+                entry_fire (engine, engine->batch[i]);
+        return;
+    }
+
+    status = pthread_mutex_lock (&engine->work_mutex);
+    if (status != 0)
+        err_abort (status, "Lock work");
+    engine->batch_count = count;
+    engine->chunk_count = (count + engine->batch_chunk - 1) / engine->batch_chunk;
+    engine->chunk_next = 0;
+    engine->chunk_emit = 0;
+    memset (engine->chunk_ready, 0, engine->chunk_count);
+    status = alarm_clock_cond_broadcast (&engine->work_cond);
+    if (status != 0)
+        err_abort (status, "Broadcast work");
+    if (engine->chunk_count > engine->worker_idle + 1)
+        worker_grow (engine);
+
+    batch_work (engine);
+    while (engine->chunk_emit < engine->chunk_count) {
+        status = alarm_clock_cond_wait (&engine->batch_cond, &engine->work_mutex);
+        if (status != 0)
+            err_abort (status, "Wait for batch");
+    }
+    status = pthread_mutex_unlock (&engine->work_mutex);
+    if (status != 0)
+        err_abort (status, "Unlock work");
+}
+
+/*
+ * Take the entries due by now off the queue, marking them FIRING:
+ * every one, when batching, or else the first. Returns how many
+ * were taken, and sets *deadline to that of the first entry not yet
+ * due, or 0 if there is none. An entry the dispatcher is about to
+ * fire itself, with nothing run before it, is STARTED at once.
+ */
+static int dispatch_take (alarm_engine_t *engine, int64_t now, int64_t *deadline)
+{
+    alarm_entry_t *entry;
+    deadline_node_t *node;
+    int count = 0;
+
+    *deadline = 0;
+    alarm_lock_write (&engine->lock);
+    while ((node = alarm_queue_peek (&engine->queue)) != NULL) {
+        if (node->deadline > now) {
+            *deadline = node->deadline;
+            break;
+        }
+        alarm_queue_pop (&engine->queue);
+        entry = (alarm_entry_t*)node;
+        entry->state = engine->batch_chunk == 0 && engine->worker_max == 0
+            ? ENTRY_STARTED : ENTRY_FIRING;
+        engine->batch[count++] = entry;
+        if (engine->batch_chunk == 0)
+            break;
+    }
+    alarm_lock_write_done (&engine->lock);
+    return count;
+}
+
+/*
+ * Fire, or hand to the workers, the count entries dispatch_take
+ * took.
+ */
+static void dispatch_fire (alarm_engine_t *engine, int count)
+{
+    if (engine->batch_chunk > 0)
+        batch_fire (engine, count);
+    else if (engine->worker_max == 0)
+        entry_fire (engine, engine->batch[0]);
+    else if (ready_push (engine, engine->batch[0]) != 0
+            && entry_start (engine, engine->batch[0]))
+        entry_fire (engine, engine->batch[0]);
+}
+
+/*
+ * How early to wake for a deadline: enough to cover the overshoot
+ * of most timed waits on this host, going by the mean and the mean
+ * deviation of those seen so far (as TCP sets its retransmission
+ * timeout from round trip times), but never more than spin_limit.
+ */
+static int64_t spin_margin (alarm_engine_t *engine)
+{
+    /* The mean, plus four times the deviation. */
+    int64_t margin = engine->wake_mean / 8 + engine->wake_dev;
+
+    return margin < engine->spin_limit ? margin : engine->spin_limit;
+}
+
+/*
+ * A timed wait meant to end at wake has timed out: learn from how
+ * late it was, then spin until deadline. Called, and returns, with
+ * the engine mutex held; it is released while spinning. A schedule
+ * for an earlier deadline that comes in meanwhile waits for the spin
+ * to end, so it may fire up to a margin late.
+ */
+static void dispatch_spin (alarm_engine_t *engine, int64_t wake, int64_t deadline)
+{
+    int64_t now = alarm_clock_now (), late = now - wake, error;
+
+    if (late < 0)
+        late = 0;
+    error = late - engine->wake_mean / 8;
+    engine->wake_mean += error;
+    if (error < 0)
+        error = -error;
+    engine->wake_dev += error - engine->wake_dev / 4;
+
+    if (now >= deadline)
+        return;
+    engine_unlock (engine);
+    while (alarm_clock_now () < deadline)
+        tsc_relax ();
+    engine_lock (engine);
+}
+
+/*
+ * The dispatcher's start routine. Like the alarm thread of
+ * alarm_cond.c it sleeps until the earliest deadline. Before it
+ * looks at the queue it notes the wakeup count; a writer that
+ * changes the queue after that bumps the count, and the dispatcher
+ * looks again instead of going to sleep on a stale deadline.
+ *
+ * When batching, it takes every entry due by now off the queue in
+ * one go, rather than one at a time. With spin_limit set, it wakes
+ * a margin before the deadline and spins the rest of the way.
+ */
+static void *dispatcher_routine (void *arg)
+{
+    alarm_engine_t *engine = (alarm_engine_t*)arg;
+    unsigned long seen;
+    int64_t deadline, wake;
+    int count, status;
+
+    engine_lock (engine);
+    while (!engine->shutdown) {
+        seen = engine->wakeups;
+        engine_unlock (engine);
+
+        count = dispatch_take (engine, alarm_clock_now (), &deadline);
+        if (count > 0) {
+            dispatch_fire (engine, count);
+            engine_lock (engine);
+            continue;
+        }
+
+        engine_lock (engine);
+        if (engine->wakeups != seen || engine->shutdown)
+            continue;
+        engine->current = deadline;
+        if (deadline == 0) {
+            status = alarm_clock_cond_wait (&engine->cond, &engine->mutex);
+            if (status != 0)
+                err_abort (status, "Wait on engine");
+        } else {
+            wake = deadline - spin_margin (engine);
+            status = alarm_clock_cond_timedwait (
+                &engine->cond, &engine->mutex, wake);
+            if (status != 0 && status != ETIMEDOUT)
+                err_abort (status, "Timed wait on engine");
+            if (status == ETIMEDOUT && engine->spin_limit > 0)
+                dispatch_spin (engine, wake, deadline);
+        }
+    }
+    engine_unlock (engine);
+    return NULL;
+}
+
+/*
+ * The start routine of a busy-polling dispatcher (attr.busy_poll).
+ * It never sleeps: it spins reading the time-stamp counter and the
+ * change count, and only takes the lock to look at the queue when
+ * the earliest deadline it knows of has come or the queue has
+ * changed since it last looked.
+ */
+static void *poll_routine (void *arg)
+{
+    alarm_engine_t *engine = (alarm_engine_t*)arg;
+    tsc_clock_t clock;
+    unsigned long seen = 0, changes;
+    int64_t deadline = 0, now;
+    int count;
+
+    tsc_clock_init (&clock);
+    while (!atomic_load_explicit (&engine->poll_stop, memory_order_relaxed)) {
+        changes = atomic_load (&engine->poll_changes);
+        now = tsc_clock_now (&clock);
+        if (changes == seen && (deadline == 0 || now < deadline)) {
+            if (now - clock.base_ns >= TSC_ANCHOR_INTERVAL)
+                tsc_clock_anchor (&clock);
+            tsc_relax ();
+            continue;
+        }
+        seen = changes;
+        count = dispatch_take (engine, now, &deadline);
+        if (count > 0) {
+            dispatch_fire (engine, count);
+            seen--;             /* Look again at once */
+        }
+    }
+    return NULL;
+}
+
+/*
+ * Tell the dispatcher the queue has changed, waking it if it is
+ * idle or if deadline is before the one it is waiting for.
+ */
+static void engine_wake (alarm_engine_t *engine, int64_t deadline)
+{
+    int status;
+
+    if (engine->busy_poll) {
+        atomic_fetch_add (&engine->poll_changes, 1);
+        return;
+    }
+    engine_lock (engine);
+    engine->wakeups++;
+    if (engine->current == 0 || deadline < engine->current) {
+        status = alarm_clock_cond_signal (&engine->cond);
+        if (status != 0)
+            err_abort (status, "Signal engine");
+    }
+    engine_unlock (engine);
+}
+
+void alarm_engine_attr_init (alarm_engine_attr_t *attr)
+{
+    attr->capacity = ALARM_ENGINE_CAPACITY;
+    attr->workers = 0;
+    attr->max_workers = 0;
+    attr->batch = 0;
+    attr->realtime = 0;
+    attr->priority = ALARM_ENGINE_PRIORITY;
+    attr->worker_priority = ALARM_ENGINE_PRIORITY - 1;
+    attr->cpu = -1;
+    attr->busy_poll = 0;
+    attr->spin = 0;
+}
+
+/*
+ * Set up thread_attr for a real-time thread at priority, pinned to
+ * cpu if cpu is 0 or above, or else kept off avoid if that is 0 or
+ * above and there is another CPU to run on. Returns 0, or an error
+ * number.
+ */
+static int realtime_attr (pthread_attr_t *thread_attr,
+    int priority, int cpu, int avoid)
+{
+    struct sched_param param;
+    int status;
+#ifdef __linux__
+    cpu_set_t cpus;
+#endif
+
+    pthread_attr_init (thread_attr);
+    param.sched_priority = priority;
+    status = pthread_attr_setinheritsched (
+        thread_attr, PTHREAD_EXPLICIT_SCHED);
+    if (status == 0)
+        status = pthread_attr_setschedpolicy (thread_attr, SCHED_FIFO);
+    if (status == 0)
+        status = pthread_attr_setschedparam (thread_attr, &param);
+#ifdef __linux__
+    if (status == 0 && cpu >= 0) {
+        CPU_ZERO (&cpus);
+        CPU_SET (cpu, &cpus);
+        status = pthread_attr_setaffinity_np (
+            thread_attr, sizeof (cpus), &cpus);
+    } else if (status == 0 && avoid >= 0
+            && sched_getaffinity (0, sizeof (cpus), &cpus) == 0) {
+        CPU_CLR (avoid, &cpus);
+        if (CPU_COUNT (&cpus) > 0)
+            status = pthread_attr_setaffinity_np (
+                thread_attr, sizeof (cpus), &cpus);
+    }
+#else
+    if (status == 0 && cpu >= 0)
+        status = ENOTSUP;
+#endif
+    if (status != 0)
+        pthread_attr_destroy (thread_attr);
+    return status;
+}
+
+/*
+ * Check the real-time attributes, and lock the process's memory.
+ * Batching and an elastic pool are refused, since both allocate
+ * while alarms fire.
+ */
+static int realtime_check (const alarm_engine_attr_t *attr)
+{
+    int low = sched_get_priority_min (SCHED_FIFO);
+    int high = sched_get_priority_max (SCHED_FIFO);
+
+    if (attr->priority < low || attr->priority > high
+            || attr->worker_priority < low || attr->worker_priority > high)
+        return EINVAL;
+    if (attr->batch > 0 || attr->max_workers == ALARM_ENGINE_CPUS
+            || attr->max_workers > attr->workers)
+        return EINVAL;
+#ifdef __linux__
+    if (attr->cpu >= CPU_SETSIZE)
+        return EINVAL;
+#endif
+    if (mlockall (MCL_CURRENT | MCL_FUTURE) != 0)
+        return errno == EAGAIN ? ENOMEM : errno;
+    return 0;
+}
+
+static void engine_free (alarm_engine_t *engine)
+{
+    int i;
+
+    if (engine->captures != NULL)
+        for (i = 0; i < engine->chunk_max; i++)
+            free (engine->captures[i].data);
+    free (engine->captures);
+    free (engine->chunk_ready);
+    free (engine->batch);
+    alarm_queue_destroy (&engine->queue);
+    free (engine->entries);
+    free (engine->table);
+    free (engine->ready);
+    if (engine->worker_attr_p != NULL)
+        pthread_attr_destroy (engine->worker_attr_p);
+    free (engine);
+}
+
+/*
+ * Stop the workers, and wait for them all to be gone.
+ */
+static void workers_stop (alarm_engine_t *engine)
+{
+    pthread_mutex_lock (&engine->work_mutex);
+    engine->workers_stop = 1;
+    alarm_clock_cond_broadcast (&engine->work_cond);
+    while (engine->worker_count > 0)
+        alarm_clock_cond_wait (&engine->work_exit, &engine->work_mutex);
+    pthread_mutex_unlock (&engine->work_mutex);
+    if (engine->worker_unjoined)
+        pthread_join (engine->worker_exited, NULL);
+    engine->worker_unjoined = 0;
+}
+
+/*
+ * The most CPUs' worth of time the process can use: the online
+ * processors it may run on, or, under a cgroup CPU quota (cpu.max
+ * in cgroup v2, cpu.cfs_quota_us in v1), the quota over the period,
+ * rounded up. At least 1.
+ */
+static int cpu_limit (void)
+{
+    long cpus = sysconf (_SC_NPROCESSORS_ONLN), quota, period;
+#ifdef __linux__
+    cpu_set_t set;
+    FILE *file;
+    int found = 0;
+
+    if (sched_getaffinity (0, sizeof (set), &set) == 0
+            && CPU_COUNT (&set) < cpus)
+        cpus = CPU_COUNT (&set);
+    file = fopen ("/sys/fs/cgroup/cpu.max", "r");
+    if (file != NULL) {
+        /* "max 100000" when there is no quota */
+        found = fscanf (file, "%ld %ld", &quota, &period) == 2;
+        fclose (file);
+    } else {
+        file = fopen ("/sys/fs/cgroup/cpu/cpu.cfs_quota_us", "r");
+        if (file != NULL) {
+            found = fscanf (file, "%ld", &quota) == 1;
+            fclose (file);
+        }
+        file = fopen ("/sys/fs/cgroup/cpu/cpu.cfs_period_us", "r");
+        if (file != NULL) {
+            found = fscanf (file, "%ld", &period) == 1 && found;
+            fclose (file);
+        }
+    }
+    if (found && quota > 0 && period > 0
+            && (quota + period - 1) / period < cpus)
+        cpus = (quota + period - 1) / period;
+#endif
+    return cpus < 1 ? 1 : (int)cpus;
+}
+
+/*
+ * Create an engine and start its dispatcher. attr may be NULL for
+ * the defaults. Returns 0, or an error number.
+ */
+int alarm_engine_create (
+    alarm_engine_t **engine_out, const alarm_engine_attr_t *attr)
+{
+    alarm_engine_attr_t defaults;
+    alarm_engine_t *engine;
+    pthread_condattr_t cond_attr;
+    pthread_attr_t thread_attr, *dispatcher_attr = NULL;
+    pthread_t thread;
+    int status, i;
+
+    if (attr == NULL) {
+        alarm_engine_attr_init (&defaults);
+        attr = &defaults;
+    }
+    if (attr->capacity < 1 || attr->workers < 0 || attr->batch < 0)
+        return EINVAL;
+    if (attr->max_workers < ALARM_ENGINE_CPUS
+            || (attr->max_workers > 0 && attr->max_workers < attr->workers))
+        return EINVAL;
+    if (attr->spin < 0)
+        return EINVAL;
+#if ALARM_CLOCK == ALARM_CLOCK_VIRTUAL
+    if (attr->busy_poll || attr->spin > 0)
+        return EINVAL;
+#endif
+    /* A real-time spinner with no CPU of its own starves the rest. */
+    if (attr->busy_poll && attr->realtime && attr->cpu < 0)
+        return EINVAL;
+
+    /*
+     * Aligned to the strictest member, which may be cache-line
+     * aligned lock state.
+     */
+    if (posix_memalign ((void**)&engine,
+            _Alignof (alarm_engine_t), sizeof (alarm_engine_t)) != 0)
+        return ENOMEM;
+    memset (engine, 0, sizeof (alarm_engine_t));
+    engine->busy_poll = attr->busy_poll;
+    engine->spin_limit = attr->spin;
+    atomic_init (&engine->poll_changes, 0);
+    atomic_init (&engine->poll_stop, 0);
+    engine->table_size = 2 * attr->capacity;
+    engine->entries = (alarm_entry_t*)calloc (
+        attr->capacity, sizeof (alarm_entry_t));
+    engine->table = (alarm_entry_t**)calloc (
+        engine->table_size, sizeof (alarm_entry_t*));
+    engine->ready_size = attr->capacity;
+    engine->ready = (alarm_entry_t**)calloc (
+        engine->ready_size, sizeof (alarm_entry_t*));
+    engine->worker_min = attr->workers;
+    engine->worker_max = attr->workers;
+    if (attr->max_workers == ALARM_ENGINE_CPUS)
+        engine->worker_max = cpu_limit ();
+    else if (attr->max_workers > 0)
+        engine->worker_max = attr->max_workers;
+    if (engine->worker_max < engine->worker_min)
+        engine->worker_max = engine->worker_min;
+    engine->batch = (alarm_entry_t**)calloc (
+        attr->capacity, sizeof (alarm_entry_t*));
+    if (attr->batch > 0) {
+        engine->batch_chunk = attr->batch;
+        engine->chunk_max = (attr->capacity + attr->batch - 1) / attr->batch;
+        engine->captures = (alarm_sink_capture_t*)calloc (
+            engine->chunk_max, sizeof (alarm_sink_capture_t));
+        engine->chunk_ready = (char*)calloc (engine->chunk_max, 1);
+    }
+    if (engine->entries == NULL || engine->table == NULL
+        || engine->ready == NULL
+        || engine->batch == NULL
+        || (attr->batch > 0
+            && (engine->captures == NULL || engine->chunk_ready == NULL))
+        || alarm_queue_init (&engine->queue, attr->capacity) != 0) {
+        engine_free (engine);
+        return ENOMEM;
+    }
+    for (i = attr->capacity - 1; i >= 0; i--) {
+        engine->entries[i].deadline.index = -1;
+        engine->entries[i].link = engine->free_list;
+        engine->free_list = &engine->entries[i];
+    }
+    if (attr->realtime) {
+        status = realtime_check (attr);
+        if (status != 0) {
+            engine_free (engine);
+            return status;
+        }
+    }
+
+    alarm_lock_init (&engine->lock);
+    pthread_mutex_init (&engine->mutex, NULL);
+    pthread_condattr_init (&cond_attr);
+    pthread_condattr_setclock (&cond_attr, ALARM_CLOCK_COND_ID);
+    pthread_cond_init (&engine->cond, &cond_attr);
+    pthread_cond_init (&engine->fired, NULL);
+    pthread_mutex_init (&engine->work_mutex, NULL);
+    pthread_cond_init (&engine->work_cond, &cond_attr);
+    pthread_cond_init (&engine->work_exit, NULL);
+    pthread_cond_init (&engine->batch_cond, NULL);
+    pthread_condattr_destroy (&cond_attr);
+
+    /*
+     * An elastic pool starts workers as it goes, so the workers'
+     * attributes are kept for as long as the engine.
+     */
+    if (attr->realtime) {
+        status = realtime_attr (&engine->worker_attr,
+            attr->worker_priority, -1, attr->cpu);
+        if (status != 0) {
+            alarm_lock_destroy (&engine->lock);
+            engine_free (engine);
+            return status;
+        }
+        engine->worker_attr_p = &engine->worker_attr;
+    }
+    status = 0;
+    engine->worker_count = attr->workers;
+    for (i = 0; i < attr->workers; i++) {
+        status = alarm_clock_thread_create (
+            &thread, engine->worker_attr_p, worker_routine, engine);
+        if (status != 0)
+            break;
+    }
+    if (status != 0) {
+        pthread_mutex_lock (&engine->work_mutex);
+        engine->worker_count -= attr->workers - i;
+        pthread_mutex_unlock (&engine->work_mutex);
+        workers_stop (engine);
+        alarm_lock_destroy (&engine->lock);
+        engine_free (engine);
+        return status;
+    }
+
+    if (attr->realtime) {
+        status = realtime_attr (&thread_attr, attr->priority, attr->cpu, -1);
+        if (status == 0)
+            dispatcher_attr = &thread_attr;
+    }
+    if (status == 0) {
+        status = alarm_clock_thread_create (&engine->dispatcher,
+            dispatcher_attr, engine->busy_poll ? poll_routine
+            : dispatcher_routine, engine);
+        if (dispatcher_attr != NULL)
+            pthread_attr_destroy (dispatcher_attr);
+    }
+    if (status != 0) {
+        workers_stop (engine);
+        alarm_lock_destroy (&engine->lock);
+        engine_free (engine);
+        return status;
+    }
+    *engine_out = engine;
+    return 0;
+}
+
+/*
+ * Stop the dispatcher, drop every alarm still scheduled and free
+ * the engine. Must not be called from a fire callback.
+ */
+int alarm_engine_destroy (alarm_engine_t *engine)
+{
+    alarm_entry_t *entry;
+    deadline_node_t *node;
+    int status;
+
+    engine_lock (engine);
+    engine->shutdown = 1;
+    alarm_clock_cond_signal (&engine->cond);
+    engine_unlock (engine);
+    atomic_store (&engine->poll_stop, 1);
+
+    status = pthread_join (engine->dispatcher, NULL);
+    if (status != 0)
+        return status;
+    workers_stop (engine);
+
+    /*
+     * Drop whatever the workers did not get to, and everything
+     * still waiting in the queue.
+     */
+    for (; engine->ready_count > 0; engine->ready_count--) {
+        entry = engine->ready[engine->ready_head];
+        engine->ready_head = (engine->ready_head + 1) % engine->ready_size;
+        if (entry->drop != NULL)
+            entry->drop (entry->payload.bytes);
+    }
+    while ((node = alarm_queue_pop (&engine->queue)) != NULL) {
+        entry = (alarm_entry_t*)node;
+        if (entry->drop != NULL)
+            entry->drop (entry->payload.bytes);
+    }
+    pthread_cond_destroy (&engine->batch_cond);
+    pthread_cond_destroy (&engine->work_exit);
+    pthread_cond_destroy (&engine->work_cond);
+    pthread_mutex_destroy (&engine->work_mutex);
+    pthread_cond_destroy (&engine->fired);
+    pthread_cond_destroy (&engine->cond);
+    pthread_mutex_destroy (&engine->mutex);
+    alarm_lock_destroy (&engine->lock);
+    engine_free (engine);
+    return 0;
+}
+
+/*
+ * Take an entry from the pool, or return NULL if every entry is in
+ * use. The caller fills in fire, drop and the payload, then either
+ * schedules the entry or gives it back with alarm_engine_free.
+ */
+alarm_entry_t *alarm_engine_alloc (alarm_engine_t *engine)
+{
+    alarm_entry_t *entry;
+
+    alarm_lock_write (&engine->lock);
+    entry = engine->free_list;
+    if (entry != NULL) {
+        engine->free_list = entry->link;
+        entry->state = ENTRY_RESERVED;
+        entry->link = NULL;
+        entry->fire = NULL;
+        entry->drop = NULL;
+        entry->deadline.index = -1;
+    }
+    alarm_lock_write_done (&engine->lock);
+    return entry;
+}
+
+/*
+ * Give back an entry that was allocated but never scheduled,
+ * calling its drop routine if it has one.
+ */
+void alarm_engine_free (alarm_engine_t *engine, alarm_entry_t *entry)
+{
+    alarm_lock_write (&engine->lock);
+    entry_release (engine, entry);
+    alarm_lock_write_done (&engine->lock);
+}
+
+/*
+ * Schedule an allocated entry as alarm message_number, to fire at
+ * deadline and then every period nanoseconds after it (or only
+ * once, if period is 0). Returns 0,
+ * EINVAL, or EEXIST if an alarm with that number is already
+ * scheduled; on error the entry still belongs to the caller.
+ */
+static int engine_schedule (alarm_engine_t *engine,
+    alarm_entry_t *entry, int message_number, int64_t deadline, int64_t period)
+{
+    alarm_entry_t **slot;
+    int status;
+
+    alarm_lock_write (&engine->lock);
+    slot = table_slot (engine, message_number);
+    if (*slot != NULL) {
+        alarm_lock_write_done (&engine->lock);
+        return EEXIST;
+    }
+    entry->deadline.key = message_number;
+    entry->deadline.deadline = deadline;
+    entry->period = period;
+    entry->state = ENTRY_QUEUED;
+    entry->link = NULL;
+    *slot = entry;
+    status = alarm_queue_push (&engine->queue, &entry->deadline);
+    if (status != 0)
+        err_abort (status, "Queue alarm");
+    alarm_lock_write_done (&engine->lock);
+
+    engine_wake (engine, entry->deadline.deadline);
+    return 0;
+}
+
+/*
+ * Schedule an allocated entry to fire delay nanoseconds from now;
+ * see engine_schedule.
+ */
+int alarm_engine_schedule (alarm_engine_t *engine,
+    alarm_entry_t *entry, int message_number, int64_t delay, int64_t period)
+{
+    if (entry->fire == NULL || delay < 0 || period < 0)
+        return EINVAL;
+    return engine_schedule (engine, entry, message_number,
+        alarm_clock_now () + delay, period);
+}
+
+/*
+ * Schedule an allocated entry to fire at deadline, a time of
+ * alarm_engine_now's clock, which may already have passed; alarms
+ * given the same deadline and period fall due together every
+ * period. See engine_schedule.
+ */
+int alarm_engine_schedule_at (alarm_engine_t *engine,
+    alarm_entry_t *entry, int message_number, int64_t deadline, int64_t period)
+{
+    if (entry->fire == NULL || deadline < 0 || period < 0)
+        return EINVAL;
+    return engine_schedule (engine, entry, message_number, deadline, period);
+}
+
+/*
+ * Cancel alarm message_number, or, with match set, the scheduling
+ * of match of that generation. If its callback is running on
+ * another thread, wait for the callback to return, so that when
+ * this returns the payload is no longer in use. (So two callbacks
+ * must not cancel each other's alarms while both are running.) An
+ * alarm that is due but whose callback has not started yet is
+ * cancelled at once; its callback never runs, and its drop runs
+ * on the thread that would have run it. Returns 0, or ENOENT if no
+ * such alarm is scheduled.
+ */
+static int engine_cancel (alarm_engine_t *engine, int message_number,
+    alarm_entry_t *match, unsigned generation)
+{
+    alarm_entry_t **slot, *entry;
+    unsigned long seen;
+    int status;
+
+    alarm_lock_write (&engine->lock);
+    if (match != NULL) {
+        if (match->generation != generation || match->state == ENTRY_FREE
+                || match->state == ENTRY_RESERVED) {
+            alarm_lock_write_done (&engine->lock);
+            return ENOENT;
+        }
+        message_number = alarm_entry_id (match);
+    }
+    slot = table_slot (engine, message_number);
+    entry = *slot;
+    if (entry == NULL || entry->state == ENTRY_CANCELLED
+            || (match != NULL && entry != match)) {
+        alarm_lock_write_done (&engine->lock);
+        return ENOENT;
+    }
+    if (entry->state == ENTRY_FIRING) {
+        *slot = entry->link;
+        entry->state = ENTRY_CANCELLED;
+        alarm_lock_write_done (&engine->lock);
+        return 0;
+    }
+    if (entry->state != ENTRY_STARTED) {
+        alarm_queue_remove (&engine->queue, &entry->deadline);
+        *slot = entry->link;
+        entry_release (engine, entry);
+        alarm_lock_write_done (&engine->lock);
+        return 0;
+    }
+
+    /*
+     * The callback is running. Whoever runs it frees the entry when
+     * it returns, under the write lock, and then bumps fired_count;
+     * so a count taken while the entry is still in the table is sure
+     * to move on once the entry is gone.
+     * A callback cancelling its own alarm cannot wait for itself.
+     */
+    entry->state = ENTRY_CANCELLED;
+    if (entry != firing_entry) {
+        while (*table_slot (engine, message_number) == entry) {
+            engine_lock (engine);
+            seen = engine->fired_count;
+            engine_unlock (engine);
+            alarm_lock_write_done (&engine->lock);
+
+            engine_lock (engine);
+            while (engine->fired_count == seen) {
+                status = alarm_clock_cond_wait (&engine->fired, &engine->mutex);
+                if (status != 0)
+                    err_abort (status, "Wait for callback");
+            }
+            engine_unlock (engine);
+            alarm_lock_write (&engine->lock);
+        }
+    }
+    alarm_lock_write_done (&engine->lock);
+    return 0;
+}
+
+int alarm_engine_cancel (alarm_engine_t *engine, int message_number)
+{
+    return engine_cancel (engine, message_number, NULL, 0);
+}
+
+/*
+ * Cancel the scheduling of entry whose generation was read before
+ * it was scheduled, as alarm_engine_cancel does; returns ENOENT,
+ * and cancels nothing, if that alarm is already done with, even if
+ * its message number or its entry has been scheduled again since.
+ */
+int alarm_engine_cancel_entry (
+    alarm_engine_t *engine, alarm_entry_t *entry, unsigned generation)
+{
+    return engine_cancel (engine, 0, entry, generation);
+}
+
+/*
+ * Store the n alarms due soonest in due, soonest first, and return
+ * how many were stored, or -1 with errno set if memory ran out.
+ * This is the engine's read path: it only takes the read side of
+ * the engine lock.
+ */
+int alarm_engine_next (alarm_engine_t *engine, alarm_engine_due_t *due, int n)
+{
+    deadline_node_t **nodes;
+    unsigned token;
+    int count, i;
+
+    if (n <= 0)
+        return 0;
+    nodes = (deadline_node_t**)malloc (n * sizeof (deadline_node_t*));
+    if (nodes == NULL)
+        return -1;
+    token = alarm_lock_read (&engine->lock);
+    count = alarm_queue_smallest (&engine->queue, nodes, n);
+    for (i = 0; i < count; i++) {
+        due[i].message_number = nodes[i]->key;
+        due[i].deadline = nodes[i]->deadline;
+    }
+    alarm_lock_read_done (&engine->lock, token);
+    free (nodes);
+    return count;
+}
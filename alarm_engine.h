@@ -0,0 +1,191 @@
+#ifndef __alarm_engine_h
+#define __alarm_engine_h
+
+#include <stddef.h>
+#include <stdint.h>
+#include "deadline_heap.h"
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+/*
+ * An embeddable alarm engine: the dispatcher of alarm_cond.c, which
+ * sleeps on a condition variable until the earliest deadline, with
+ * the alarm list replaced by a deadline heap and the printf replaced
+ * by a callback.
+ *
+ * Alarms are identified by a message number, as in New_Alarm_Cond.c,
+ * and may be one-shot or periodic. Every alarm lives in an entry
+ * taken from a pool that is allocated when the engine is created,
+ * and the caller's data is stored inline in the entry's payload, so
+ * scheduling an alarm never allocates memory.
+ *
+ *      entry = alarm_engine_alloc (engine);
+ *      entry->fire = my_fire;
+ *      memcpy (entry->payload.bytes, &my_data, sizeof (my_data));
+ *      status = alarm_engine_schedule (engine, entry, 7, delay, period);
+ *
+ * Times are in nanoseconds of the clock chosen by ALARM_CLOCK (see
+ * alarm_config.h); alarm_engine_now reads it.
+ */
+typedef struct alarm_entry_tag alarm_entry_t;
+typedef struct alarm_engine_tag alarm_engine_t;
+
+/*
+ * fire is called by the dispatcher, or by one of the engine's
+ * workers if it has any, each time the alarm expires, with no
+ * engine lock held. An alarm's callback never runs twice at once.
+ * It may schedule or cancel alarms, including its own. drop, if
+ * set, is called exactly once when the entry goes back to the pool,
+ * to release whatever the payload holds; it runs with the engine
+ * locked and must not call the engine.
+ */
+typedef void (*alarm_fire_t) (alarm_entry_t *entry, void *payload);
+typedef void (*alarm_drop_t) (void *payload);
+
+#define ALARM_PAYLOAD_SIZE      64
+
+struct alarm_entry_tag {
+    deadline_node_t     deadline; /* key is the message number */
+    int64_t             period; /* 0 for a one-shot alarm */
+    alarm_fire_t        fire;
+    alarm_drop_t        drop;
+    int                 state;  /* Private to the engine */
+    unsigned            generation; /* Bumped each time it is freed */
+    alarm_entry_t       *link;  /* Private to the engine */
+    union {
+        long double     align;
+        void            *align_pointer;
+        unsigned char   bytes[ALARM_PAYLOAD_SIZE];
+    } payload;
+};
+
+/* The message number of an entry, and the deadline it fired for. */
+#define alarm_entry_id(entry)           ((entry)->deadline.key)
+#define alarm_entry_deadline(entry)     ((entry)->deadline.deadline)
+
+/*
+ * An entry's generation, read between alarm_engine_alloc and
+ * alarm_engine_schedule, names that one scheduling of it for
+ * alarm_engine_cancel_entry: once the alarm is done with and the
+ * entry back in the pool, the generation has moved on, and neither
+ * a later alarm with the same message number nor one that reuses
+ * the entry is taken for it.
+ */
+#define alarm_entry_generation(entry)   ((entry)->generation)
+
+/* One answer to alarm_engine_next. */
+typedef struct alarm_engine_due_tag {
+    int                 message_number;
+    int64_t             deadline;
+} alarm_engine_due_t;
+
+/*
+ * capacity is the size of the entry pool. With workers at 0 the
+ * dispatcher runs every callback itself; otherwise it hands due
+ * alarms to that many worker threads.
+ *
+ * With max_workers set, the pool is elastic: it starts with workers
+ * threads (which may be 0), and adds one, up to max_workers, each
+ * time alarms are handed over with no worker idle to take them, or a
+ * worker takes an alarm more than ALARM_ENGINE_LATE late with none
+ * idle; a worker beyond the first workers exits once it has been
+ * idle for ALARM_ENGINE_IDLE. With max_workers at ALARM_ENGINE_CPUS
+ * the limit is the CPUs the process can use, read at create: the
+ * online processors it may run on, or fewer under a cgroup CPU quota
+ * (rounded up), so that a container limited to a fraction of a CPU
+ * does not run more callbacks at once than it has time for, and get
+ * throttled. Starting a worker allocates its stack, on the path of
+ * the thread that found the need.
+ *
+ * With batch set, the dispatcher takes every alarm that is due at
+ * once as a batch, in deadline order, and splits it into chunks of
+ * batch alarms that the workers and the dispatcher fire in
+ * parallel. What the callbacks write through alarm_sink_write is
+ * put back in batch order before it is written, so the output is
+ * the same however many workers there are. A batch is done before
+ * the next is taken.
+ *
+ * With realtime set, the engine is made for deployments where
+ * firing on time matters more than anything else:
+ *
+ *  - Create locks every page of the process into memory with
+ *    mlockall, which also faults in the engine's pools, and keeps
+ *    later mappings (such as thread stacks) locked too. This is
+ *    process-wide, and stays in force after the engine is gone.
+ *  - The dispatcher runs SCHED_FIFO at priority, and the workers
+ *    at worker_priority.
+ *  - With cpu at 0 or above, the dispatcher is pinned to that CPU
+ *    and the workers kept off it (Linux only). Keeping everything
+ *    else off it too is for the system to do, with isolcpus= or a
+ *    cpuset.
+ *
+ * Nothing the dispatcher or the workers do after create allocates
+ * memory, and neither do alarm_engine_alloc, _schedule and _cancel.
+ * Outside real-time mode there are two exceptions, which real-time
+ * mode refuses, with EINVAL: with batch set, a chunk's output
+ * capture grows to the size of the largest chunk's output, and an
+ * elastic pool allocates a stack for each worker it adds.
+ * alarm_engine_next allocates, and belongs on a path that can
+ * afford it. Setting a
+ * real-time policy needs privileges (CAP_SYS_NICE on Linux), and
+ * locking memory may need RLIMIT_MEMLOCK raised; create returns
+ * EPERM or ENOMEM if they are missing.
+ *
+ * With busy_poll set, the dispatcher never sleeps: it spins on a
+ * clock read from the processor's time-stamp counter (see tsc.h)
+ * and on a count of queue changes, and fires, or hands to the
+ * workers, each alarm within a few microseconds of its deadline.
+ * Scheduling then never signals it either. That costs a whole CPU,
+ * so it is meant to go with realtime and a cpu of its own; with
+ * realtime, a cpu is required. It needs a real clock.
+ *
+ * Timed waits end late, by tens of microseconds on an idle host and
+ * by much more on a busy one. With spin set, the dispatcher learns
+ * how late its waits end, wakes that much before each deadline, at
+ * most spin nanoseconds before, and spins the rest of the way; so
+ * each alarm costs at most spin of CPU for its precision. It needs
+ * a real clock.
+ */
+typedef struct alarm_engine_attr_tag {
+    int                 capacity; /* Most alarms scheduled at once */
+    int                 workers;
+    int                 max_workers; /* Elastic pool's limit, or 0 */
+    int                 batch;  /* Alarms per chunk of a batch, or 0 */
+    int                 realtime; /* Nonzero for real-time mode */
+    int                 priority; /* The dispatcher's SCHED_FIFO priority */
+    int                 worker_priority; /* The workers' */
+    int                 cpu;    /* CPU for the dispatcher, or -1 */
+    int                 busy_poll; /* Nonzero for a polling dispatcher */
+    int64_t             spin;   /* Most nanoseconds to spin, or 0 */
+} alarm_engine_attr_t;
+
+#define ALARM_ENGINE_CAPACITY   1024
+#define ALARM_ENGINE_PRIORITY   80      /* Default dispatcher priority */
+#define ALARM_ENGINE_CPUS       (-1)    /* max_workers: the CPU limit */
+#define ALARM_ENGINE_LATE       1000000 /* ns late that grows the pool */
+#define ALARM_ENGINE_IDLE       ((int64_t)2000000000) /* ns idle to shrink */
+
+extern void alarm_engine_attr_init (alarm_engine_attr_t *attr);
+extern int alarm_engine_create (
+    alarm_engine_t **engine, const alarm_engine_attr_t *attr);
+extern int alarm_engine_destroy (alarm_engine_t *engine);
+extern alarm_entry_t *alarm_engine_alloc (alarm_engine_t *engine);
+extern void alarm_engine_free (alarm_engine_t *engine, alarm_entry_t *entry);
+extern int alarm_engine_schedule (alarm_engine_t *engine,
+    alarm_entry_t *entry, int message_number, int64_t delay, int64_t period);
+extern int alarm_engine_schedule_at (alarm_engine_t *engine,
+    alarm_entry_t *entry, int message_number, int64_t deadline, int64_t period);
+extern int alarm_engine_cancel (alarm_engine_t *engine, int message_number);
+extern int alarm_engine_cancel_entry (
+    alarm_engine_t *engine, alarm_entry_t *entry, unsigned generation);
+extern int alarm_engine_next (
+    alarm_engine_t *engine, alarm_engine_due_t *due, int n);
+extern int64_t alarm_engine_now (void);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif
@@ -0,0 +1,171 @@
+#ifndef __alarm_engine_hpp
+#define __alarm_engine_hpp
+
+/*
+ * A header-only C++ interface to the alarm engine (alarm_engine.h).
+ *
+ * alarm::engine owns an engine and destroys it, and alarm::handle
+ * owns one scheduled alarm and cancels it. A handle names its alarm
+ * by entry and generation (alarm_engine_cancel_entry), not by
+ * message number, so once a one-shot alarm has fired, cancelling
+ * its handle does nothing, even if the number has been reused. schedule() constructs
+ * the callable directly in the entry's inline payload and installs
+ * a fire routine instantiated for its exact type, so scheduling
+ * never allocates and the callable's body is inlined into that
+ * routine; the engine's only call per fire is the one to the
+ * routine.
+ *
+ *      alarm::engine engine;
+ *      alarm::handle tick = engine.schedule (1, 0s, 1s, [&] { ++ticks; });
+ *
+ * Callables must fit in ALARM_PAYLOAD_SIZE bytes and must not throw.
+ */
+#include <chrono>
+#include <cstddef>
+#include <new>
+#include <system_error>
+#include <type_traits>
+#include <utility>
+#include "alarm_engine.h"
+
+namespace alarm {
+
+class handle {
+public:
+    handle () noexcept
+        : engine_ (nullptr), entry_ (nullptr), generation_ (0), id_ (0) {}
+    handle (alarm_engine_t *engine, alarm_entry_t *entry,
+        unsigned generation, int id) noexcept
+        : engine_ (engine), entry_ (entry), generation_ (generation), id_ (id)
+    {}
+    handle (handle &&other) noexcept
+        : engine_ (other.engine_), entry_ (other.entry_),
+          generation_ (other.generation_), id_ (other.id_)
+    {
+        other.engine_ = nullptr;
+    }
+    handle &operator= (handle &&other) noexcept
+    {
+        if (this != &other) {
+            cancel ();
+            engine_ = other.engine_;
+            entry_ = other.entry_;
+            generation_ = other.generation_;
+            id_ = other.id_;
+            other.engine_ = nullptr;
+        }
+        return *this;
+    }
+    handle (const handle &) = delete;
+    handle &operator= (const handle &) = delete;
+    ~handle () { cancel (); }
+
+    /*
+     * Cancel the alarm, waiting for a callback that is running on
+     * another thread to return. Does nothing if already cancelled,
+     * or if a one-shot alarm has already fired.
+     */
+    void cancel () noexcept
+    {
+        if (engine_ != nullptr) {
+            alarm_engine_cancel_entry (engine_, entry_, generation_);
+            engine_ = nullptr;
+        }
+    }
+
+    /* Let the alarm run on without this handle. */
+    int release () noexcept
+    {
+        engine_ = nullptr;
+        return id_;
+    }
+
+    int id () const noexcept { return id_; }
+    explicit operator bool () const noexcept { return engine_ != nullptr; }
+
+private:
+    alarm_engine_t *engine_;
+    alarm_entry_t *entry_;
+    unsigned generation_;
+    int id_;
+};
+
+class engine {
+public:
+    explicit engine (int capacity = ALARM_ENGINE_CAPACITY, int workers = 0)
+    {
+        alarm_engine_attr_t attr;
+        int status;
+
+        alarm_engine_attr_init (&attr);
+        attr.capacity = capacity;
+        attr.workers = workers;
+        status = alarm_engine_create (&engine_, &attr);
+        if (status != 0)
+            throw std::system_error (
+                status, std::generic_category (), "alarm_engine_create");
+    }
+    engine (const engine &) = delete;
+    engine &operator= (const engine &) = delete;
+    ~engine () { alarm_engine_destroy (engine_); }
+
+    /*
+     * Schedule f as alarm id, to run after delay and then every
+     * period (or once, if period is zero). Throws std::system_error
+     * with ENOSPC if the pool is exhausted, or EEXIST if id is in use.
+     */
+    template <typename F, typename Rep1, typename Period1,
+        typename Rep2, typename Period2>
+    handle schedule (int id, std::chrono::duration<Rep1, Period1> delay,
+        std::chrono::duration<Rep2, Period2> period, F &&f)
+    {
+        using fn_type = typename std::decay<F>::type;
+        static_assert (sizeof (fn_type) <= ALARM_PAYLOAD_SIZE,
+            "callable does not fit in an alarm payload");
+        static_assert (alignof (fn_type) <= alignof (alarm_entry_t),
+            "callable is over-aligned for an alarm payload");
+        alarm_entry_t *entry;
+        unsigned generation;
+        int status;
+
+        entry = alarm_engine_alloc (engine_);
+        if (entry == nullptr)
+            throw std::system_error (
+                ENOSPC, std::generic_category (), "alarm_engine_alloc");
+        generation = alarm_entry_generation (entry);
+        ::new (static_cast<void *> (entry->payload.bytes))
+            fn_type (std::forward<F> (f));
+        entry->fire = &fire<fn_type>;
+        entry->drop = &drop<fn_type>;
+        status = alarm_engine_schedule (engine_, entry, id,
+            std::chrono::duration_cast<std::chrono::nanoseconds> (delay).count (),
+            std::chrono::duration_cast<std::chrono::nanoseconds> (period).count ());
+        if (status != 0) {
+            alarm_engine_free (engine_, entry);
+            throw std::system_error (
+                status, std::generic_category (), "alarm_engine_schedule");
+        }
+        return handle (engine_, entry, generation, id);
+    }
+
+    alarm_engine_t *native_handle () const noexcept { return engine_; }
+
+private:
+    template <typename Fn>
+    static void fire (alarm_entry_t *, void *payload) noexcept
+    {
+        (*static_cast<Fn *> (payload)) ();
+    }
+
+    template <typename Fn>
+    static void drop (void *payload) noexcept
+    {
+        static_cast<Fn *> (payload)->~Fn ();
+    }
+
+    alarm_engine_t *engine_;
+};
+
+}
+
+#endif
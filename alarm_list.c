@@ -0,0 +1,868 @@
+/*
+ * alarm_list.c
+ *
+ * The alarm list of New_Alarm_Cond.c and the operations on it,
+ * separated from the program's threads so that they can be driven
+ * directly (see bench/bench_list.c).
+ */
+#include <limits.h>
+#include <pthread.h>
+#include <sched.h>
+#include <stddef.h>
+#include <time.h>
+#include "errors.h"
+#include "alarm_clock.h"
+#include "alarm_list.h"
+#include "skiplist.h"
+#include "btree.h"
+#include "tsc.h"
+
+/*
+ * Payload writers only have to be serialized against each other;
+ * readers never wait for them, and they never wait for readers.
+ */
+pthread_mutex_t payload_mutex = PTHREAD_MUTEX_INITIALIZER;
+
+/* Takes a consistent copy of an alarm's payload without locking. */
+void alarm_read_payload(alarm_t *alarm, alarm_summary_t *summary) {
+    unsigned seq;
+
+    summary->message_number = alarm->message_number;
+    do {
+        seq = seqlock_read_begin(&alarm->payload_lock);
+        summary->seconds = alarm->seconds;
+        summary->time = alarm->time;
+        memcpy(summary->message, alarm->message, sizeof(summary->message));
+    } while(seqlock_read_retry(&alarm->payload_lock, seq));
+    summary->message[sizeof(summary->message) - 1] = '\0';
+}
+
+/*
+ * Marks an alarm as cancelled. Returns 0, or -1 if a cancel request
+ * had already been received for it.
+ */
+int alarm_request_cancel(alarm_t *alarm) {
+    unsigned old = atomic_fetch_or(&alarm->state, ALARM_CANCELLED);
+
+    return (old & ALARM_CANCELLED) ? -1 : 0;
+}
+
+/*
+ * Takes another reference to an alarm for a new owner. Returns 0, or
+ * -1 if the last reference has already gone; that can only happen
+ * to an alarm just found in the skip list index, which its last
+ * owner may have released meanwhile.
+ */
+int alarm_hold(alarm_t *alarm) {
+    int refs = atomic_load(&alarm->refs);
+
+    do {
+        if(refs == 0)
+            return -1;
+    } while(!atomic_compare_exchange_weak(&alarm->refs, &refs, refs + 1));
+    return 0;
+}
+
+#if ALARM_INDEX == ALARM_INDEX_SKIPLIST
+static void alarm_reclaim(epoch_retired_t *retired) {
+    free((char*)retired - offsetof(alarm_t, retired));
+}
+#endif
+
+/*
+ * Drops one owner's reference to an alarm, and frees the alarm if it
+ * was the last. The alarm must no longer be on the list or in
+ * due_heap by then. Lookups in the skip list hold no lock that would
+ * keep the alarm from going while they look at it, so there the
+ * alarm is retired instead, and freed once they are all done.
+ */
+void alarm_release(alarm_t *alarm) {
+    if(atomic_fetch_sub(&alarm->refs, 1) == 1) {
+#if ALARM_INDEX == ALARM_INDEX_SKIPLIST
+        epoch_retire(&alarm->retired, alarm_reclaim);
+#else
+        free(alarm);
+#endif
+    }
+}
+
+void alarm_cursor_init(alarm_cursor_t *cursor) {
+    cursor->last_key = 0;
+    cursor->version = 0;
+    cursor->done = 0;
+    cursor->hint = NULL;
+}
+
+#if ALARM_INDEX != ALARM_INDEX_SKIPLIST
+
+/*
+ * The alarm list (or B+-tree index) is protected by list_lock, a
+ * big-reader lock (brlock.h): readers on different processors do
+ * not contend, and a writer waiting for the lock holds new readers
+ * off, so a steady stream of readers cannot starve inserts and
+ * cancels. Writers combine their changes (see combine below), so
+ * that under contention one hold of the lock makes many of them.
+ */
+brlock_t list_lock;
+
+/* The slot this thread's read hold is counted in. */
+static __thread int read_slot;
+
+void reader_enter() {
+    read_slot = brlock_read_lock(&list_lock);
+}
+
+void reader_exit() {
+    brlock_read_unlock(&list_lock, read_slot);
+}
+
+#endif
+
+#if ALARM_INDEX == ALARM_INDEX_LIST
+
+alarm_t *alarm_list = NULL;
+
+/*
+ * Every insert or removal bumps alarm_version while it holds the
+ * write lock, so a reader can tell whether the list changed between
+ * two visits. Replacing a payload is not a change to the list.
+ */
+unsigned long alarm_version = 0;
+
+/*
+ * Copies up to max alarms with a message number above the cursor's
+ * last_key into page and returns how many were copied. Each page is
+ * read under a single hold of the read lock and so reflects one
+ * version of the list (recorded in cursor->version), and each
+ * payload is copied through its sequence lock; no lock is held
+ * between calls, so writers can get in between pages. Sets
+ * cursor->done once the end of the list has been reached.
+ */
+int alarm_list_page(alarm_cursor_t *cursor, alarm_summary_t *page, int max) {
+    alarm_t *next;
+    int count = 0;
+
+    if(cursor->done)
+        return 0;
+
+    reader_enter();
+
+    if(cursor->hint != NULL && cursor->version == alarm_version)
+        next = cursor->hint->link;
+    else {
+        next = alarm_list;
+        while(next != NULL && next->message_number <= cursor->last_key)
+            next = next->link;
+    }
+
+    for(; next != NULL && count < max; next = next->link) {
+        alarm_read_payload(next, &page[count]);
+        cursor->last_key = next->message_number;
+        cursor->hint = next;
+        count++;
+    }
+    if(next == NULL)
+        cursor->done = 1;
+    cursor->version = alarm_version;
+
+    reader_exit();
+
+    return count;
+}
+
+/*
+ * Stores up to max alarms with message numbers from first to last in
+ * found, in message number order, and returns how many were stored.
+ * Must be called under a read hold, which keeps them allocated until
+ * it is released.
+ */
+int alarm_list_range(int first, int last, alarm_t **found, int max) {
+    alarm_t *next;
+    int count = 0;
+
+    for(next = alarm_list; next != NULL && next->message_number < first;
+            next = next->link)
+        ;
+    for(; next != NULL && next->message_number <= last && count < max;
+            next = next->link)
+        found[count++] = next;
+    return count;
+}
+
+#else
+
+#if ALARM_INDEX == ALARM_INDEX_SKIPLIST
+
+/*
+ * The skip list index: alarm_index holds every alarm on the list,
+ * keyed by message number. Inserts and cancels need no lock, so
+ * several threads can make them at once, and a "read hold" is only
+ * an epoch bracket (epoch.h), which keeps whatever it finds from
+ * being freed until it is over.
+ */
+static skiplist_t alarm_index;
+
+void reader_enter() {
+    epoch_enter();
+}
+
+void reader_exit() {
+    epoch_exit();
+}
+
+static int index_scan(int after, alarm_t **found, int max) {
+    return skiplist_scan(&alarm_index, after, (void**)found, max);
+}
+
+#else
+
+/*
+ * The B+-tree index: alarm_index holds every alarm on the list,
+ * keyed by message number, under list_lock. A lookup reads one
+ * cache line of keys at each of a few levels instead of following a
+ * link per alarm, and a scan reads each leaf's array of alarms in
+ * turn, so neither needs the cursor's hint.
+ */
+static btree_t alarm_index;
+
+static int index_scan(int after, alarm_t **found, int max) {
+    return btree_scan(&alarm_index, after, (void**)found, max);
+}
+
+#endif
+
+/*
+ * As above, but found from the index in O(log n) wherever the cursor
+ * is. With the skip list a page is not a snapshot: alarms inserted
+ * or cancelled while it is copied may or may not be on it.
+ */
+int alarm_list_page(alarm_cursor_t *cursor, alarm_summary_t *page, int max) {
+    alarm_t *found[ALARM_PAGE_SIZE];
+    int count, i;
+
+    if(cursor->done)
+        return 0;
+    if(max > ALARM_PAGE_SIZE)
+        max = ALARM_PAGE_SIZE;
+
+    reader_enter();
+
+    count = index_scan(cursor->last_key, found, max);
+    for(i = 0; i < count; i++)
+        alarm_read_payload(found[i], &page[i]);
+    if(count > 0)
+        cursor->last_key = page[count - 1].message_number;
+    if(count < max)
+        cursor->done = 1;
+
+    reader_exit();
+
+    return count;
+}
+
+/* As above. */
+int alarm_list_range(int first, int last, alarm_t **found, int max) {
+    int count, i;
+
+    if(first > last)
+        return 0;
+    count = index_scan(first == INT_MIN ? INT_MIN : first - 1, found, max);
+    for(i = 0; i < count && found[i]->message_number <= last; i++)
+        ;
+    return i;
+}
+
+#endif
+
+/*
+ * In charge of printing the list of alarms. The list is copied out
+ * a page at a time through alarm_list_page, and each page is printed
+ * after the read lock has been released, so a long list (or a slow
+ * terminal) never holds writers off for more than one page.
+ */
+void print_alarm_list() {
+    alarm_summary_t page[ALARM_PAGE_SIZE];
+    alarm_cursor_t cursor;
+    int count, i;
+
+    alarm_cursor_init(&cursor);
+
+    printf ("[list: ");
+    while((count = alarm_list_page(&cursor, page, ALARM_PAGE_SIZE)) > 0) {
+        for(i = 0; i < count; i++)
+            printf ("%ld(%ld)[\"%s\"]", page[i].time,
+                page[i].time - alarm_clock_time (), page[i].message);
+    }
+    printf ("]\n");
+}
+
+/*
+ * Every running display thread keeps its alarm's next display time
+ * in due_heap, so the alarms due soonest can be found without a
+ * walk of the alarm list. due_mutex protects the heap.
+ */
+pthread_mutex_t due_mutex = PTHREAD_MUTEX_INITIALIZER;
+deadline_heap_t due_heap;
+
+/*
+ * Sets the time of an alarm's next display, queueing the alarm in
+ * due_heap if it is not there yet, or removes it from the heap if
+ * when is 0.
+ */
+void alarm_set_due(alarm_t *alarm, time_t when) {
+    int status;
+
+    status = pthread_mutex_lock(&due_mutex);
+    if (status != 0)
+        err_abort (status, "Lock due mutex");
+
+    if(when == 0) {
+        if(alarm->deadline.index >= 0)
+            deadline_heap_remove(&due_heap, &alarm->deadline);
+    } else {
+        alarm->deadline.deadline = when;
+        if(alarm->deadline.index >= 0)
+            deadline_heap_update(&due_heap, &alarm->deadline);
+        else {
+            status = deadline_heap_push(&due_heap, &alarm->deadline);
+            if (status != 0)
+                err_abort (status, "Queue alarm deadline");
+        }
+    }
+
+    status = pthread_mutex_unlock(&due_mutex);
+    if (status != 0)
+        err_abort (status, "Unlock due mutex");
+}
+
+/*
+ * Stores the n alarms that will be displayed soonest, soonest first,
+ * in a list it allocates and points *due at, and returns how many
+ * were stored. n is capped at the number of alarms in due_heap, so a
+ * large n costs no more than listing every alarm. The answer comes
+ * from due_heap in O(n log n), however long the alarm list is.
+ * Returns -1, with errno set, if the list cannot be allocated; the
+ * caller frees *due.
+ */
+int alarm_next_due(alarm_due_t **due, int n) {
+    deadline_node_t **nodes = NULL;
+    alarm_due_t *list = NULL;
+    int count = -1, i, status;
+
+    status = pthread_mutex_lock(&due_mutex);
+    if (status != 0)
+        err_abort (status, "Lock due mutex");
+
+    if (n > due_heap.count)
+        n = due_heap.count;
+    nodes = (deadline_node_t**)malloc((n + 1) * sizeof(deadline_node_t*));
+    list = (alarm_due_t*)malloc((n + 1) * sizeof(alarm_due_t));
+    if (nodes != NULL && list != NULL)
+        count = deadline_heap_smallest(&due_heap, nodes, n);
+    for(i = 0; i < count; i++) {
+        list[i].message_number = nodes[i]->key;
+        list[i].time = nodes[i]->deadline;
+    }
+
+    status = pthread_mutex_unlock(&due_mutex);
+    if (status != 0)
+        err_abort (status, "Unlock due mutex");
+
+    free(nodes);
+    if (count < 0) {
+        free(list);
+        errno = ENOMEM;
+        return -1;
+    }
+    *due = list;
+    return count;
+}
+
+/* Fetches the alarm with the given alarm number to it. */
+alarm_t *get_alarm_at(int m_id) {
+#if ALARM_INDEX == ALARM_INDEX_LIST
+    alarm_t *next;
+
+    if(alarm_list != NULL) {
+        for(next = alarm_list; next != NULL; next = next->link) {
+            if(next->message_number == m_id)
+                return next;
+        }
+    }
+    return NULL;
+#elif ALARM_INDEX == ALARM_INDEX_SKIPLIST
+    return (alarm_t*)skiplist_find(&alarm_index, m_id);
+#else
+    return (alarm_t*)btree_find(&alarm_index, m_id);
+#endif
+}
+
+/*
+ * Checks whether an alarm exists in the alarm list with the message
+ * number of a newly received alarm request and return true or false.
+ * The read hold keeps the alarm from being unlinked and freed while
+ * it is looked at.
+ */
+int message_id_exists(int m_id) {
+    alarm_t *alarm;
+
+    reader_enter();
+    alarm = get_alarm_at(m_id);
+    reader_exit();
+    if (alarm != NULL)
+        return 1;
+    else
+        return 0;
+
+}
+
+/*
+ * Writes a replacement's payload into an alarm, and flags the
+ * replacement.
+ */
+static void replace_payload(alarm_t *old_alarm, alarm_t *new_alarm) {
+    unsigned state;
+    int status;
+
+    status = pthread_mutex_lock(&payload_mutex);
+    if (status != 0)
+        err_abort (status, "Lock payload mutex");
+
+    seqlock_write_begin(&old_alarm->payload_lock);
+    old_alarm->seconds = new_alarm->seconds;
+    old_alarm->time = alarm_clock_time() + new_alarm->seconds;
+    strcpy(old_alarm->message , new_alarm->message);
+    seqlock_write_end(&old_alarm->payload_lock);
+
+    /*
+     * Flag the replacement and start a new generation in one step,
+     * so a reader never sees the flag without the new generation.
+     */
+    state = atomic_load(&old_alarm->state);
+    while(!atomic_compare_exchange_weak(&old_alarm->state, &state,
+            (state | ALARM_REPLACED) + (1u << ALARM_GENERATION_SHIFT)))
+        ;
+
+    status = pthread_mutex_unlock(&payload_mutex);
+    if (status != 0)
+        err_abort (status, "Unlock payload mutex");
+}
+
+#if ALARM_INDEX == ALARM_INDEX_SKIPLIST
+
+/*
+ * If an alarm request of Type A is received and there exists an
+ * alarm of Type A in the alarm list with the same message number,
+ * then the old alarm is replaced by this function. new_alarm only
+ * carries the new payload, and stays the caller's.
+ */
+void find_and_replace(alarm_t *new_alarm) {
+    alarm_t *old_alarm;
+
+    /*
+     * The read hold keeps old_alarm on the list, and so allocated,
+     * until the new payload is in.
+     */
+    reader_enter();
+    old_alarm = get_alarm_at(new_alarm->message_number);
+    if(old_alarm != NULL)
+        replace_payload(old_alarm, new_alarm);
+    reader_exit();
+}
+
+/*
+ * Used to remove any nodes (alarm requests) from the alarm list.
+ * Returns 1 if this call removed the alarm, in which case the list's
+ * reference to it is handed to the caller, who releases it with
+ * alarm_release once it is done with the alarm; or 0 if the alarm
+ * was no longer on the list. Other threads may be cancelling at the
+ * same time.
+ */
+int cancel_alarm (alarm_t *alarm) {
+    if(skiplist_remove(&alarm_index, alarm->message_number, alarm) == NULL)
+        return 0;
+    atomic_fetch_and(&alarm->state, ~ALARM_ACTIVE);
+    return 1;
+}
+
+/*
+ * Inserts a new alarm into the alarm list, sorted by message number.
+ * Waking the alarm thread is up to the caller. Other threads may be
+ * inserting at the same time, and a message number can only be on
+ * the list once. Returns 0, or EEXIST (and leaves the alarm the
+ * caller's) if it is there already. An alarm that has been
+ * cancelled is not there, though it stays on the list until its
+ * class is done with it: it is removed, and the list's reference to
+ * it dropped, to make way for the new one.
+ */
+int alarm_insert(alarm_t *alarm) {
+    alarm_t *old_alarm;
+    int status;
+
+    reader_enter();
+    while((status = skiplist_insert(&alarm_index, alarm->message_number,
+            alarm)) == EEXIST) {
+        old_alarm = get_alarm_at(alarm->message_number);
+        if(old_alarm == NULL)
+            continue;
+        if(!(atomic_load(&old_alarm->state) & ALARM_CANCELLED))
+            break;
+        if(cancel_alarm(old_alarm))
+            alarm_release(old_alarm);
+    }
+    reader_exit();
+    if (status == ENOMEM)
+        errno_abort ("Insert alarm");
+    return status;
+}
+
+#else
+
+/*
+ * The changes themselves, made with list_lock held for writing.
+ */
+static int cancel_locked (alarm_t *alarm);
+
+/*
+ * An alarm that has been cancelled stays on the list until its class
+ * is done with it, but makes way at once for a new alarm with its
+ * message number: it is unlinked, and the list's reference to it
+ * dropped. Returns EEXIST if the alarm has not been cancelled.
+ */
+static int displace_locked (alarm_t *old_alarm) {
+    if(!(atomic_load(&old_alarm->state) & ALARM_CANCELLED))
+        return EEXIST;
+    if(cancel_locked(old_alarm))
+        alarm_release(old_alarm);
+    return 0;
+}
+
+#if ALARM_INDEX == ALARM_INDEX_LIST
+
+static int cancel_locked (alarm_t *alarm) {
+    alarm_t *prev;
+
+    prev = alarm_list;
+
+    if(alarm_list != NULL) {
+        if(alarm_list == alarm) {
+            if(alarm_list->link == NULL)
+                alarm_list = NULL;
+            else
+                alarm_list = alarm_list->link;
+        } else {
+            while(prev->link != NULL && prev->link != alarm)
+                prev = prev->link;
+
+            if(prev->link == NULL)
+                return 0;
+            prev->link = prev->link->link;
+        }
+        atomic_fetch_and(&alarm->state, ~ALARM_ACTIVE);
+        alarm_version++;
+        return 1;
+    }
+    return 0;
+}
+
+
+static int insert_locked(alarm_t *alarm) {
+    alarm_t **last, *next;
+
+    /*
+     * LOCKING PROTOCOL!!!
+     */
+    last = &alarm_list;
+    next = *last;
+    while (next != NULL) {
+        if (next->message_number == alarm->message_number) {
+            if (displace_locked (next) != 0)
+                return EEXIST;
+            next = *last;
+            continue;
+        }
+        if (next->message_number > alarm->message_number) {
+            alarm->link = next;
+            *last = alarm;
+            break;
+        }
+        last = &next->link;
+        next = next->link;
+    }
+    /*
+     * If we reached the end of the list, insert the new alarm
+     * there. ("next" is NULL, and "last" points to the link
+     * field of the last item, or to the list header.)
+     */
+    if (next == NULL) {
+        *last = alarm;
+        alarm->link = NULL;
+    }
+    alarm_version++;
+    return 0;
+}
+
+#else
+
+static int cancel_locked (alarm_t *alarm) {
+    if(btree_find(&alarm_index, alarm->message_number) != alarm)
+        return 0;
+    btree_remove(&alarm_index, alarm->message_number);
+    atomic_fetch_and(&alarm->state, ~ALARM_ACTIVE);
+    return 1;
+}
+
+static int insert_locked(alarm_t *alarm) {
+    alarm_t *old_alarm = btree_find(&alarm_index, alarm->message_number);
+
+    if(old_alarm != NULL && displace_locked(old_alarm) != 0)
+        return EEXIST;
+    return btree_insert(&alarm_index, alarm->message_number, alarm);
+}
+
+#endif
+
+static void replace_locked(alarm_t *new_alarm) {
+    alarm_t *old_alarm = get_alarm_at(new_alarm->message_number);
+
+    if(old_alarm != NULL)
+        replace_payload(old_alarm, new_alarm);
+}
+
+#if ALARM_LIST_COMBINE
+
+/*
+ * Flat combining. Rather than each writer taking list_lock in turn,
+ * so that the lock and the list bounce from one processor to the
+ * next, a writer publishes its change in a record of its own, and
+ * whichever writer gets to be the combiner takes list_lock once and
+ * makes every change published, while the list is hot in its cache;
+ * the others wait for their records to be cleared. Under contention
+ * one lock hold serves many changes; without it, a writer finds no
+ * combiner and makes its own change, at the cost of a scan of the
+ * records.
+ *
+ * Each thread that writes has a record, on a list of records that
+ * only ever grows; a thread's record is freed for reuse when the
+ * thread exits, so the list stays as long as the most threads that
+ * have written at once. A record's op is set last by its owner, and
+ * cleared last by the combiner, so each hands the rest of the record
+ * over to the other.
+ */
+#define COMBINE_NONE    0
+#define COMBINE_INSERT  1
+#define COMBINE_CANCEL  2
+#define COMBINE_REPLACE 3
+
+#define COMBINE_PASSES  4       /* Most passes over the records a hold */
+#define COMBINE_SPINS   64      /* Polls of a record before yielding */
+
+typedef struct combine_record_tag {
+    _Alignas (BRLOCK_LINE) atomic_int op; /* Pending change, or NONE */
+    alarm_t             *alarm;
+    int                 result;
+    atomic_int          owned;  /* Some thread's record */
+    struct combine_record_tag *next;
+} combine_record_t;
+
+static _Atomic(combine_record_t*) combine_records;
+static atomic_int combining;    /* A writer is combining */
+static pthread_key_t combine_key;
+static pthread_once_t combine_once = PTHREAD_ONCE_INIT;
+static __thread combine_record_t *combine_mine;
+
+static void combine_release(void *record) {
+    atomic_store(&((combine_record_t*)record)->owned, 0);
+}
+
+static void combine_key_create(void) {
+    int status = pthread_key_create(&combine_key, combine_release);
+
+    if (status != 0)
+        err_abort (status, "Create combine key");
+}
+
+/*
+ * The calling thread's record: one left by a thread that has exited,
+ * if there is one, or else a new one.
+ */
+static combine_record_t *combine_record(void) {
+    combine_record_t *record = combine_mine, *head;
+    int unowned, status;
+
+    if (record != NULL)
+        return record;
+    pthread_once(&combine_once, combine_key_create);
+    for (record = atomic_load(&combine_records); record != NULL;
+            record = record->next) {
+        unowned = 0;
+        if (atomic_compare_exchange_strong(&record->owned, &unowned, 1))
+            break;
+    }
+    if (record == NULL) {
+        if (posix_memalign((void**)&record, BRLOCK_LINE,
+                sizeof(combine_record_t)) != 0)
+            errno_abort ("Allocate combine record");
+        atomic_init(&record->op, COMBINE_NONE);
+        atomic_init(&record->owned, 1);
+        head = atomic_load(&combine_records);
+        do
+            record->next = head;
+        while (!atomic_compare_exchange_weak(&combine_records, &head, record));
+    }
+    status = pthread_setspecific(combine_key, record);
+    if (status != 0)
+        err_abort (status, "Set combine record");
+    combine_mine = record;
+    return record;
+}
+
+/*
+ * As the combiner, make every change published, going over the
+ * records again while the last pass found any, up to COMBINE_PASSES.
+ */
+static void combine_apply(void) {
+    combine_record_t *record;
+    int op, found, pass;
+
+    brlock_write_lock(&list_lock);
+    for (pass = 0, found = 1; pass < COMBINE_PASSES && found; pass++) {
+        found = 0;
+        for (record = atomic_load(&combine_records); record != NULL;
+                record = record->next) {
+            op = atomic_load_explicit(&record->op, memory_order_acquire);
+            if (op == COMBINE_NONE)
+                continue;
+            if (op == COMBINE_INSERT)
+                record->result = insert_locked(record->alarm);
+            else if (op == COMBINE_CANCEL)
+                record->result = cancel_locked(record->alarm);
+            else
+                replace_locked(record->alarm);
+            atomic_store_explicit(&record->op, COMBINE_NONE,
+                memory_order_release);
+            found = 1;
+        }
+    }
+    brlock_write_unlock(&list_lock);
+}
+
+/*
+ * Publish a change and wait until some combiner, perhaps this
+ * thread, has made it. Returns the change's result.
+ */
+static int combine(int op, alarm_t *alarm) {
+    combine_record_t *record = combine_record();
+    int spins = 0, busy;
+
+    record->alarm = alarm;
+    atomic_store_explicit(&record->op, op, memory_order_release);
+    while (atomic_load_explicit(&record->op, memory_order_acquire)
+            != COMBINE_NONE) {
+        busy = 0;
+        if (atomic_load_explicit(&combining, memory_order_relaxed) == 0
+                && atomic_compare_exchange_strong(&combining, &busy, 1)) {
+            combine_apply();
+            atomic_store(&combining, 0);
+        } else if (++spins < COMBINE_SPINS)
+            tsc_relax();
+        else {
+            spins = 0;
+            sched_yield();
+        }
+    }
+    return record->result;
+}
+
+#endif
+
+/*
+ * If an alarm request of Type A is received and there exists an
+ * alarm of Type A in the alarm list with the same message number,
+ * then the old alarm is replaced by this function. new_alarm only
+ * carries the new payload, and stays the caller's.
+ */
+void find_and_replace(alarm_t *new_alarm) {
+#if ALARM_LIST_COMBINE
+    combine(COMBINE_REPLACE, new_alarm);
+#else
+    /*
+     * The read hold keeps the alarm on the list, and so allocated,
+     * until the new payload is in.
+     */
+    reader_enter();
+    replace_locked(new_alarm);
+    reader_exit();
+#endif
+}
+
+/*
+ * Used to remove any nodes (alarm requests) from the alarm list.
+ * Returns 1 if this call removed the alarm, in which case the list's
+ * reference to it is handed to the caller, who releases it with
+ * alarm_release once it is done with the alarm; or 0 if the alarm
+ * was no longer on the list.
+ */
+int cancel_alarm (alarm_t *alarm) {
+    int removed;
+
+#if ALARM_LIST_COMBINE
+    removed = combine(COMBINE_CANCEL, alarm);
+#else
+    brlock_write_lock(&list_lock);
+    removed = cancel_locked(alarm);
+    brlock_write_unlock(&list_lock);
+#endif
+    return removed;
+}
+
+/*
+ * Inserts a new alarm into the alarm list, sorted by message number.
+ * Waking the alarm thread is up to the caller. A message number can
+ * only be on the list once, so the test for an existing alarm is
+ * made under the same write hold as the insert. Returns 0, or
+ * EEXIST (and leaves the alarm the caller's) if it is there already.
+ * A cancelled alarm is not there, and makes way for the new one (see
+ * displace_locked).
+ */
+int alarm_insert(alarm_t *alarm) {
+    int status;
+
+#if ALARM_LIST_COMBINE
+    status = combine(COMBINE_INSERT, alarm);
+#else
+    brlock_write_lock(&list_lock);
+    status = insert_locked(alarm);
+    brlock_write_unlock(&list_lock);
+#endif
+    if (status == ENOMEM)
+        errno_abort ("Insert alarm");
+    return status;
+}
+
+#endif
+
+/*
+ * Sets up the list lock (or index) and the due heap. Must be called before
+ * any other function in this file.
+ */
+void alarm_list_init() {
+    int status;
+
+#if ALARM_INDEX != ALARM_INDEX_SKIPLIST
+    brlock_init(&list_lock);
+#endif
+#if ALARM_INDEX == ALARM_INDEX_SKIPLIST
+    status = skiplist_init(&alarm_index);
+#elif ALARM_INDEX == ALARM_INDEX_BTREE
+    status = btree_init(&alarm_index);
+#endif
+#if ALARM_INDEX != ALARM_INDEX_LIST
+    if (status != 0)
+        err_abort (status, "Initialize alarm index");
+#endif
+
+    status = deadline_heap_init(&due_heap, 64);
+    if (status != 0)
+        err_abort (status, "Initialize due heap");
+}
@@ -0,0 +1,121 @@
+#ifndef __alarm_list_h
+#define __alarm_list_h
+
+#include <pthread.h>
+#include <time.h>
+#include "alarm_config.h"
+#include "seqlock.h"
+#include "brlock.h"
+#include "epoch.h"
+#include "deadline_heap.h"
+
+/*
+ * seconds, time and message make up the payload of an alarm, which
+ * a replacement request rewrites in place. They are guarded by
+ * payload_lock, so display threads and lookups read them without
+ * taking any lock (see alarm_read_payload).
+ *
+ * state is the alarm's lifecycle word: the ALARM_ACTIVE, _REPLACED
+ * and _CANCELLED flags in the low bits and, above them, a
+ * generation that counts replacements. It is only changed with
+ * atomic operations, so it can be tested from any thread.
+ *
+ * deadline is the alarm's entry in due_heap, and holds the time of
+ * its next display while its display thread is running.
+ *
+ * refs counts the owners of the alarm: one for the alarm list, from
+ * the insert until it is unlinked (by cancel_alarm, or, once it has
+ * been cancelled, by the insert of a new alarm with its message
+ * number), and one for its display thread while that runs. Each
+ * owner calls alarm_release when it is done, and the last one frees
+ * the alarm (with the skip list index, through retired, once no
+ * lookup can still be looking at it).
+ *
+ * link chains the alarm list; the skip list and B+-tree indexes do
+ * not use it.
+ */
+typedef struct alarm_tag {
+    struct alarm_tag    *link;
+    int                 seconds;
+    int                 message_number; /* Message identifier */
+    atomic_uint         state;  /* Lifecycle flags and generation */
+    atomic_int          refs;
+    seqlock_t           payload_lock;
+    deadline_node_t     deadline; /* Next display, in due_heap */
+    epoch_retired_t     retired;
+    time_t              time;   /* Seconds from EPOCH */
+    char                message[128]; /* Message */
+} alarm_t;
+
+#define ALARM_ACTIVE            0x1     /* Linked on the alarm list */
+#define ALARM_REPLACED          0x2     /* Payload replaced at least once */
+#define ALARM_CANCELLED         0x4     /* Cancel request received */
+#define ALARM_DISPLAYING        0x8     /* Display thread started */
+#define ALARM_GENERATION_SHIFT  8
+#define ALARM_GENERATION(state) ((state) >> ALARM_GENERATION_SHIFT)
+
+/*
+ * A copy of the fields of one alarm. The caller owns it, so it can
+ * be printed or inspected after the alarm itself has changed.
+ */
+typedef struct alarm_summary_tag {
+    int                 message_number;
+    int                 seconds;
+    time_t              time;
+    char                message[128];
+} alarm_summary_t;
+
+/*
+ * Position of a paged walk over the alarm list, in message number
+ * order. last_key is the message number of the last alarm returned,
+ * so a walk resumes correctly whatever happens to the list between
+ * pages. hint is the node holding last_key, and is only trusted if
+ * the list is still at the version the previous page was read at.
+ * (The skip list and B+-tree indexes find last_key quickly enough
+ * without them.)
+ */
+typedef struct alarm_cursor_tag {
+    int                 last_key;
+    unsigned long       version; /* Version the last page was read at */
+    int                 done;
+    alarm_t             *hint;
+} alarm_cursor_t;
+
+#define ALARM_PAGE_SIZE 256
+
+typedef struct alarm_due_tag {
+    int                 message_number;
+    time_t              time;   /* Next display, seconds from EPOCH */
+} alarm_due_t;
+
+#if ALARM_INDEX == ALARM_INDEX_LIST
+extern alarm_t *alarm_list;
+extern unsigned long alarm_version;
+#endif
+#if ALARM_INDEX != ALARM_INDEX_SKIPLIST
+extern brlock_t list_lock;
+#endif
+extern pthread_mutex_t payload_mutex;
+extern pthread_mutex_t due_mutex;
+extern deadline_heap_t due_heap;
+
+extern void alarm_list_init();
+extern void reader_enter();
+extern void reader_exit();
+extern void alarm_read_payload(alarm_t *alarm, alarm_summary_t *summary);
+extern int alarm_request_cancel(alarm_t *alarm);
+extern int alarm_hold(alarm_t *alarm);
+extern void alarm_release(alarm_t *alarm);
+extern void alarm_cursor_init(alarm_cursor_t *cursor);
+extern int alarm_list_page(alarm_cursor_t *cursor, alarm_summary_t *page, int max);
+extern int alarm_list_range(int first, int last, alarm_t **found, int max);
+extern void print_alarm_list();
+extern void alarm_set_due(alarm_t *alarm, time_t when);
+extern int alarm_next_due(alarm_due_t **due, int n);
+extern alarm_t *get_alarm_at(int m_id);
+extern int message_id_exists(int m_id);
+extern void find_and_replace(alarm_t *new_alarm);
+extern int cancel_alarm(alarm_t *alarm);
+extern int alarm_insert(alarm_t *alarm);
+
+#endif
@@ -0,0 +1,169 @@
+#ifndef __alarm_lock_h
+#define __alarm_lock_h
+
+#include <pthread.h>
+#include <semaphore.h>
+#include "errors.h"
+#include "alarm_config.h"
+#include "brlock.h"
+
+/*
+ * The engine's readers/writer lock, selected by ALARM_LOCK.
+ *
+ * Writers bracket a change with alarm_lock_write and
+ * alarm_lock_write_done, and readers with alarm_lock_read and
+ * alarm_lock_read_done, passing back the token alarm_lock_read
+ * returned (the big-reader lock's slot):
+ *
+ *      token = alarm_lock_read (&lock);
+ *      ... copy what is needed ...
+ *      alarm_lock_read_done (&lock, token);
+ */
+#if ALARM_LOCK == ALARM_LOCK_SEM
+
+/*
+ * The original protocol of New_Alarm_Cond.c: rw_mutex is held by a
+ * writer, or on behalf of all readers by the first reader in.
+ */
+typedef struct alarm_lock_tag {
+    sem_t               rw_mutex;
+    sem_t               mutex;  /* Protects read_count */
+    int                 read_count;
+} alarm_lock_t;
+
+static inline void alarm_lock_init (alarm_lock_t *lock)
+{
+    sem_init (&lock->rw_mutex, 0, 1);
+    sem_init (&lock->mutex, 0, 1);
+    lock->read_count = 0;
+}
+
+static inline void alarm_lock_destroy (alarm_lock_t *lock)
+{
+    sem_destroy (&lock->rw_mutex);
+    sem_destroy (&lock->mutex);
+}
+
+static inline unsigned alarm_lock_read (alarm_lock_t *lock)
+{
+    sem_wait (&lock->mutex);
+    if (++lock->read_count == 1)
+        sem_wait (&lock->rw_mutex);
+    sem_post (&lock->mutex);
+    return 0;
+}
+
+static inline void alarm_lock_read_done (alarm_lock_t *lock, unsigned token)
+{
+    (void)token;
+    sem_wait (&lock->mutex);
+    if (--lock->read_count == 0)
+        sem_post (&lock->rw_mutex);
+    sem_post (&lock->mutex);
+}
+
+static inline void alarm_lock_write (alarm_lock_t *lock)
+{
+    sem_wait (&lock->rw_mutex);
+}
+
+static inline void alarm_lock_write_done (alarm_lock_t *lock)
+{
+    sem_post (&lock->rw_mutex);
+}
+
+#elif ALARM_LOCK == ALARM_LOCK_RWLOCK
+
+typedef struct alarm_lock_tag {
+    pthread_rwlock_t    rwlock;
+} alarm_lock_t;
+
+static inline void alarm_lock_init (alarm_lock_t *lock)
+{
+    int status = pthread_rwlock_init (&lock->rwlock, NULL);
+
+    if (status != 0)
+        err_abort (status, "Init rwlock");
+}
+
+static inline void alarm_lock_destroy (alarm_lock_t *lock)
+{
+    pthread_rwlock_destroy (&lock->rwlock);
+}
+
+static inline unsigned alarm_lock_read (alarm_lock_t *lock)
+{
+    int status = pthread_rwlock_rdlock (&lock->rwlock);
+
+    if (status != 0)
+        err_abort (status, "Read lock");
+    return 0;
+}
+
+static inline void alarm_lock_read_done (alarm_lock_t *lock, unsigned token)
+{
+    int status = pthread_rwlock_unlock (&lock->rwlock);
+
+    (void)token;
+    if (status != 0)
+        err_abort (status, "Read unlock");
+}
+
+static inline void alarm_lock_write (alarm_lock_t *lock)
+{
+    int status = pthread_rwlock_wrlock (&lock->rwlock);
+
+    if (status != 0)
+        err_abort (status, "Write lock");
+}
+
+static inline void alarm_lock_write_done (alarm_lock_t *lock)
+{
+    int status = pthread_rwlock_unlock (&lock->rwlock);
+
+    if (status != 0)
+        err_abort (status, "Write unlock");
+}
+
+#else
+
+/*
+ * The big-reader lock; the token is the reader's slot.
+ */
+typedef struct alarm_lock_tag {
+    brlock_t            brlock;
+} alarm_lock_t;
+
+static inline void alarm_lock_init (alarm_lock_t *lock)
+{
+    brlock_init (&lock->brlock);
+}
+
+static inline void alarm_lock_destroy (alarm_lock_t *lock)
+{
+    brlock_destroy (&lock->brlock);
+}
+
+static inline unsigned alarm_lock_read (alarm_lock_t *lock)
+{
+    return (unsigned)brlock_read_lock (&lock->brlock);
+}
+
+static inline void alarm_lock_read_done (alarm_lock_t *lock, unsigned token)
+{
+    brlock_read_unlock (&lock->brlock, (int)token);
+}
+
+static inline void alarm_lock_write (alarm_lock_t *lock)
+{
+    brlock_write_lock (&lock->brlock);
+}
+
+static inline void alarm_lock_write_done (alarm_lock_t *lock)
+{
+    brlock_write_unlock (&lock->brlock);
+}
+
+#endif
+
+#endif
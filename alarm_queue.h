@@ -0,0 +1,122 @@
+#ifndef __alarm_queue_h
+#define __alarm_queue_h
+
+#include "alarm_config.h"
+#include "deadline_heap.h"
+
+/*
+ * The deadline queue the engine's dispatcher takes alarms from,
+ * selected by ALARM_QUEUE. Every implementation queues the same
+ * deadline_node_t, keeps the order of deadline_before, and provides
+ * the same operations:
+ *
+ *  alarm_queue_init      Set up an empty queue sized for size nodes.
+ *  alarm_queue_push      Queue a node; 0 or ENOMEM.
+ *  alarm_queue_remove    Take a queued node out.
+ *  alarm_queue_peek      The earliest node, or NULL. May reorganize
+ *                        the queue, so it counts as a change.
+ *  alarm_queue_pop       Remove and return the earliest node.
+ *  alarm_queue_smallest  Copy out the n earliest nodes, earliest
+ *                        first, without changing the queue; -1 if
+ *                        out of memory.
+ *
+ * A node's index is -1 while it is not queued.
+ */
+#if ALARM_QUEUE == ALARM_QUEUE_LIST
+
+/*
+ * A doubly linked list kept in deadline order, as the alarm list of
+ * alarm_cond.c. Insertion checks the tail first, so deadlines that
+ * arrive in order are appended in O(1).
+ */
+typedef struct alarm_queue_tag {
+    deadline_node_t     *head, *tail;
+    int                 count;
+} alarm_queue_t;
+
+#elif ALARM_QUEUE == ALARM_QUEUE_HEAP
+
+typedef struct alarm_queue_tag {
+    deadline_heap_t     heap;
+} alarm_queue_t;
+
+#elif ALARM_QUEUE == ALARM_QUEUE_WHEEL
+
+/*
+ * A hashed timing wheel of ALARM_WHEEL_SLOTS slots, each holding
+ * the nodes whose deadline falls in one tick of ALARM_WHEEL_TICK
+ * nanoseconds, modulo the size of the wheel. base is the tick the
+ * wheel has turned to; a node due before base is kept on the late
+ * list. A node's index is the slot it is on (ALARM_WHEEL_SLOTS for
+ * the late list).
+ */
+typedef struct alarm_queue_tag {
+    deadline_node_t     *slots[ALARM_WHEEL_SLOTS];
+    deadline_node_t     *late;
+    deadline_node_t     *min;   /* Cached earliest node, or NULL */
+    int64_t             base;
+    int                 count;
+} alarm_queue_t;
+
+#elif ALARM_QUEUE == ALARM_QUEUE_RADIX
+
+/*
+ * A radix heap in base 16. last is the deadline last taken from the
+ * queue. A node due after last goes in the bucket for the highest
+ * hex digit in which its deadline differs from last, and that
+ * digit's value in its deadline: bucket 1 + 16 * digit + value, so
+ * every node in a bucket is due before every node in the next.
+ * Bucket 0 holds the nodes due at or before last. occupied has a
+ * bit set for each bucket that is not empty. A node's index is its
+ * bucket.
+ */
+#define ALARM_RADIX_BUCKETS     (1 + 16 * 16)
+#define ALARM_RADIX_WORDS       ((ALARM_RADIX_BUCKETS + 63) / 64)
+
+typedef struct alarm_queue_tag {
+    deadline_node_t     *buckets[ALARM_RADIX_BUCKETS];
+    uint64_t            occupied[ALARM_RADIX_WORDS];
+    deadline_node_t     *min;   /* Cached earliest node, or NULL */
+    uint64_t            last;
+    int                 count;
+} alarm_queue_t;
+
+#else
+
+/*
+ * A timing wheel for the near future in front of a heap for the
+ * far. base is the tick the wheel has turned to. Nodes due up to
+ * the end of that tick (or before it) are in due, a heap of its
+ * own; the wheel's ALARM_WHEEL_SLOTS slots hold those due in each
+ * tick after it, up to the horizon a turn ahead, and occupied has a
+ * bit set for each slot that is not empty; nodes due after the
+ * horizon wait in far until the wheel turns far enough to take
+ * them.
+ *
+ * A node in either heap has its heap slot as its index, and its
+ * deadline tells which heap; on the wheel, its index is
+ * ALARM_HYBRID_SLOT of its slot, which is below -1.
+ */
+#define ALARM_HYBRID_WORDS      (ALARM_WHEEL_SLOTS / 64)
+#define ALARM_HYBRID_SLOT(slot) (-2 - (slot))
+
+typedef struct alarm_queue_tag {
+    deadline_node_t     *slots[ALARM_WHEEL_SLOTS];
+    uint64_t            occupied[ALARM_HYBRID_WORDS];
+    deadline_heap_t     due, far;
+    int64_t             base;
+    int                 near;   /* Nodes on the wheel */
+} alarm_queue_t;
+
+#endif
+
+extern int alarm_queue_init (alarm_queue_t *queue, int size);
+extern void alarm_queue_destroy (alarm_queue_t *queue);
+extern int alarm_queue_push (alarm_queue_t *queue, deadline_node_t *node);
+extern void alarm_queue_remove (alarm_queue_t *queue, deadline_node_t *node);
+extern deadline_node_t *alarm_queue_peek (alarm_queue_t *queue);
+extern deadline_node_t *alarm_queue_pop (alarm_queue_t *queue);
+extern int alarm_queue_smallest (
+    alarm_queue_t *queue, deadline_node_t **out, int n);
+
+#endif
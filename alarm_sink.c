@@ -0,0 +1,142 @@
+/*
+ * alarm_sink.c
+ *
+ * The output sink; see alarm_sink.h.
+ */
+#include <pthread.h>
+#include "errors.h"
+#include "alarm_sink.h"
+
+/* The capture this thread's lines go to, if any. */
+static __thread alarm_sink_capture_t *sink_capture;
+
+void alarm_sink_capture (alarm_sink_capture_t *capture)
+{
+    sink_capture = capture;
+}
+
+#if ALARM_SINK != ALARM_SINK_NULL
+/*
+ * Append a line to the thread's capture, if it has one, and return
+ * whether it did.
+ */
+static int sink_captured (const char *line, size_t length)
+{
+    alarm_sink_capture_t *capture = sink_capture;
+    size_t size;
+    char *data;
+
+    if (capture == NULL)
+        return 0;
+    if (capture->length + length > capture->size) {
+        size = capture->size == 0 ? 4096 : capture->size;
+        while (size < capture->length + length)
+            size *= 2;
+        data = (char*)realloc (capture->data, size);
+        if (data == NULL)
+            errno_abort ("Grow sink capture");
+        capture->data = data;
+        capture->size = size;
+    }
+    memcpy (capture->data + capture->length, line, length);
+    capture->length += length;
+    return 1;
+}
+#endif
+
+#if ALARM_SINK == ALARM_SINK_STDOUT
+
+void alarm_sink_write (const char *line, size_t length)
+{
+    if (sink_captured (line, length))
+        return;
+    fwrite (line, 1, length, stdout);
+    fflush (stdout);
+}
+
+void alarm_sink_flush (void)
+{
+}
+
+#elif ALARM_SINK == ALARM_SINK_BUFFER
+
+#define SINK_BUFFER_SIZE        65536
+
+static __thread char sink_buffer[SINK_BUFFER_SIZE];
+static __thread size_t sink_length;
+static pthread_key_t sink_key;
+static pthread_once_t sink_once = PTHREAD_ONCE_INIT;
+
+static void sink_write_all (const char *data, size_t length)
+{
+    ssize_t written;
+
+    while (length > 0) {
+        written = write (STDOUT_FILENO, data, length);
+        if (written < 0) {
+            if (errno == EINTR)
+                continue;
+            return;
+        }
+        data += written;
+        length -= written;
+    }
+}
+
+/*
+ * The key exists only for its destructor, which flushes a thread's
+ * buffer when the thread exits.
+ */
+static void sink_exit (void *arg)
+{
+    (void)arg;
+    alarm_sink_flush ();
+}
+
+static void sink_init (void)
+{
+    int status = pthread_key_create (&sink_key, sink_exit);
+
+    if (status != 0)
+        err_abort (status, "Create sink key");
+}
+
+void alarm_sink_write (const char *line, size_t length)
+{
+    if (sink_captured (line, length))
+        return;
+    if (sink_length + length > SINK_BUFFER_SIZE) {
+        alarm_sink_flush ();
+        if (length > SINK_BUFFER_SIZE) {
+            sink_write_all (line, length);
+            return;
+        }
+    }
+    if (sink_length == 0) {
+        pthread_once (&sink_once, sink_init);
+        pthread_setspecific (sink_key, sink_buffer);
+    }
+    memcpy (sink_buffer + sink_length, line, length);
+    sink_length += length;
+}
+
+void alarm_sink_flush (void)
+{
+    sink_write_all (sink_buffer, sink_length);
+    sink_length = 0;
+}
+
+#else
+
+/* Nothing is written, so nothing needs capturing either. */
+void alarm_sink_write (const char *line, size_t length)
+{
+    (void)line;
+    (void)length;
+}
+
+void alarm_sink_flush (void)
+{
+}
+
+#endif
@@ -0,0 +1,29 @@
+#ifndef __alarm_sink_h
+#define __alarm_sink_h
+
+#include <stddef.h>
+#include "alarm_config.h"
+
+/*
+ * Where output lines go, selected by ALARM_SINK. alarm_sink_write
+ * takes one complete line. With ALARM_SINK_BUFFER lines collect in
+ * a buffer private to the calling thread, which is written out when
+ * it fills, when the thread calls alarm_sink_flush, and when the
+ * thread exits.
+ *
+ * While a thread has a capture set with alarm_sink_capture, its
+ * lines are appended to the capture instead, for whoever set it to
+ * write out later, in whatever order it needs; the engine does this
+ * to keep the output of a batch of alarms in order when several
+ * threads fire them (see alarm_engine.c).
+ */
+typedef struct alarm_sink_capture_tag {
+    char                *data;
+    size_t              length, size;
+} alarm_sink_capture_t;
+
+extern void alarm_sink_write (const char *line, size_t length);
+extern void alarm_sink_flush (void);
+extern void alarm_sink_capture (alarm_sink_capture_t *capture);
+
+#endif
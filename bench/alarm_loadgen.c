@@ -0,0 +1,227 @@
+/*
+ * alarm_loadgen.c
+ *
+ * Load generator for the alarm engine. It drives the engine with
+ * one of a few workload mixes for a fixed time, then reports the
+ * engine operations completed, one line on stderr:
+ *
+ *      variant mix seconds ops ops/s schedules cancels fires queries
+ *
+ * The fire callback writes one line per fire to the configured
+ * output sink, which is stdout unless the engine was built with
+ * SINK=null.
+ *
+ * Mixes:
+ *      insert  90% schedules, 10% cancels, deadlines 1-10 s out, so
+ *              the queue fills and hardly anything fires.
+ *      cancel  schedules and cancels in equal numbers, deadlines
+ *              1-10 s out.
+ *      fire    schedules only, deadlines 0-10 ms out, so nearly
+ *              every alarm fires; when the pool runs dry the
+ *              producer waits for fires to free entries.
+ *
+ * Options:
+ *      -m mix          Workload mix (default insert)
+ *      -d seconds      Run time (default 1)
+ *      -c capacity     Engine capacity (default 65536)
+ *      -r readers      Threads asking for the next 16 alarms in a
+ *                      loop while the mix runs (default 0)
+ *      -s seed         Random seed (default 1)
+ *      -t step         With the virtual clock, microseconds of
+ *                      virtual time to advance after each batch of
+ *                      64 operations (default 1000)
+ *
+ * With the virtual clock (CLOCK=virtual), the run lasts -d seconds
+ * of virtual time, and the load generator advances the clock itself,
+ * so a long schedule takes only as long as the work it involves.
+ * seconds and ops/s are always in real time.
+ */
+#include <pthread.h>
+#include <stdatomic.h>
+#include <time.h>
+#include "errors.h"
+#include "alarm_engine.h"
+#include "alarm_clock.h"
+#include "alarm_sink.h"
+
+#define MS              ((int64_t)1000000)
+#define SECOND          ((int64_t)1000000000)
+
+typedef struct mix_tag {
+    const char          *name;
+    int                 schedule_percent;
+    int64_t             min_delay, max_delay;
+    int                 wait_for_pool; /* Wait, don't cancel, when full */
+} mix_t;
+
+static mix_t mixes[] = {
+    { "insert", 90, 1 * SECOND, 10 * SECOND, 0 },
+    { "cancel", 50, 1 * SECOND, 10 * SECOND, 0 },
+    { "fire", 100, 0, 10 * MS, 1 },
+    { NULL }
+};
+
+static alarm_engine_t *engine;
+static atomic_long fires;
+static atomic_long queries;
+static atomic_int stop;
+static int64_t step = 1000000; /* Virtual time per batch, in ns */
+
+static int64_t real_now (void)
+{
+    struct timespec now;
+
+    clock_gettime (CLOCK_MONOTONIC, &now);
+    return (int64_t)now.tv_sec * SECOND + now.tv_nsec;
+}
+
+static void loadgen_fire (alarm_entry_t *entry, void *payload)
+{
+    char line[128];
+    int64_t now = alarm_engine_now ();
+    int length;
+
+    (void)payload;
+    length = snprintf (line, sizeof (line),
+        "Alarm With Message Number (%d) Fired at <%lld>: <%lld ns late>\n",
+        alarm_entry_id (entry), (long long)now,
+        (long long)(now - alarm_entry_deadline (entry)));
+    alarm_sink_write (line, length);
+    atomic_fetch_add (&fires, 1);
+}
+
+static void *reader_routine (void *arg)
+{
+    alarm_engine_due_t due[16];
+
+    (void)arg;
+    while (!atomic_load (&stop)) {
+        if (alarm_engine_next (engine, due, 16) < 0)
+            errno_abort ("Query next alarms");
+        atomic_fetch_add (&queries, 1);
+    }
+    return NULL;
+}
+
+int main (int argc, char *argv[])
+{
+    alarm_engine_attr_t attr;
+    alarm_entry_t *entry;
+    mix_t *mix = &mixes[0];
+    pthread_t *readers;
+    double seconds = 1.0, elapsed;
+    int64_t start, end, delay;
+    long schedules = 0, cancels = 0, ops;
+    unsigned seed = 1;
+    int *live, live_count = 0, next_id = 1;
+    int capacity = 65536, reader_count = 0;
+    int option, status, victim, i;
+
+    while ((option = getopt (argc, argv, "m:d:c:r:s:t:")) != -1) {
+        switch (option) {
+        case 'm':
+            for (mix = mixes; mix->name != NULL; mix++)
+                if (strcmp (mix->name, optarg) == 0)
+                    break;
+            if (mix->name == NULL) {
+                fprintf (stderr, "Unknown mix %s\n", optarg);
+                exit (1);
+            }
+            break;
+        case 'd': seconds = atof (optarg); break;
+        case 'c': capacity = atoi (optarg); break;
+        case 'r': reader_count = atoi (optarg); break;
+        case 's': seed = atoi (optarg); break;
+        case 't': step = (int64_t)(atof (optarg) * 1000); break;
+        default:
+            fprintf (stderr, "usage: %s [-m insert|cancel|fire] [-d seconds]"
+                " [-c capacity] [-r readers] [-s seed] [-t step]\n", argv[0]);
+            exit (1);
+        }
+    }
+
+    alarm_engine_attr_init (&attr);
+    attr.capacity = capacity;
+    status = alarm_engine_create (&engine, &attr);
+    if (status != 0)
+        err_abort (status, "Create engine");
+    live = (int*)malloc (capacity * sizeof (int));
+    readers = (pthread_t*)malloc ((reader_count + 1) * sizeof (pthread_t));
+    if (live == NULL || readers == NULL)
+        errno_abort ("Allocate load generator");
+    for (i = 0; i < reader_count; i++) {
+        status = pthread_create (&readers[i], NULL, reader_routine, NULL);
+        if (status != 0)
+            err_abort (status, "Create reader");
+    }
+
+    start = real_now ();
+    end = alarm_engine_now () + (int64_t)(seconds * SECOND);
+    while (alarm_engine_now () < end) {
+        for (i = 0; i < 64; i++) {
+            if (live_count > 0
+                && (int)(rand_r (&seed) % 100) >= mix->schedule_percent) {
+                victim = rand_r (&seed) % live_count;
+                alarm_engine_cancel (engine, live[victim]);
+                live[victim] = live[--live_count];
+                cancels++;
+                continue;
+            }
+
+            entry = alarm_engine_alloc (engine);
+            if (entry == NULL) {
+                if (mix->wait_for_pool || live_count == 0) {
+                    sched_yield ();
+                    continue;
+                }
+                victim = rand_r (&seed) % live_count;
+                alarm_engine_cancel (engine, live[victim]);
+                live[victim] = live[--live_count];
+                cancels++;
+                continue;
+            }
+            entry->fire = loadgen_fire;
+            delay = mix->min_delay;
+            if (mix->max_delay > mix->min_delay)
+                delay += (int64_t)((double)rand_r (&seed) / RAND_MAX
+                    * (mix->max_delay - mix->min_delay));
+            status = alarm_engine_schedule (engine, entry, next_id, delay, 0);
+            if (status != 0)
+                err_abort (status, "Schedule alarm");
+            schedules++;
+
+            /*
+             * One-shot alarms that have fired stay on the live list;
+             * cancelling one later just finds it gone.
+             */
+            if (live_count == capacity)
+                live_count = 0;
+            live[live_count++] = next_id;
+            if (++next_id <= 0)
+                next_id = 1;
+        }
+#if ALARM_CLOCK == ALARM_CLOCK_VIRTUAL
+        alarm_clock_advance (alarm_engine_now () + step);
+#endif
+    }
+    elapsed = (double)(real_now () - start) / SECOND;
+
+    atomic_store (&stop, 1);
+    for (i = 0; i < reader_count; i++) {
+        status = pthread_join (readers[i], NULL);
+        if (status != 0)
+            err_abort (status, "Join reader");
+    }
+    status = alarm_engine_destroy (engine);
+    if (status != 0)
+        err_abort (status, "Destroy engine");
+    alarm_sink_flush ();
+
+    ops = schedules + cancels + atomic_load (&fires) + atomic_load (&queries);
+    fprintf (stderr, "%s %s %.2f %ld %.0f %ld %ld %ld %ld\n",
+        ALARM_VARIANT_NAME, mix->name, elapsed, ops, ops / elapsed,
+        schedules, cancels, atomic_load (&fires), atomic_load (&queries));
+    free (live);
+    free (readers);
+    return 0;
+}
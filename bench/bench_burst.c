@@ -0,0 +1,229 @@
+/*
+ * bench_burst.c
+ *
+ * Burst-absorption benchmark for the alarm engine. It keeps a steady
+ * background of periodic alarms firing, and then injects bursts of
+ * 10k, 100k, ... up to -m one-shot alarms all at once (as when every
+ * client re-registers together), followed by a burst cancelling them
+ * all again. For each burst it reports, one line on stderr:
+ *
+ *      variant kind size absorb_ms base_p99_us burst_p99_us burst_max_us
+ *
+ * absorb_ms runs from the first call of the burst until a probe
+ * alarm scheduled right after the last one has fired, i.e. until
+ * the engine is keeping time again. base_p99_us is the 99th
+ * percentile lateness of the background alarms in a quiet spell just
+ * before the burst, and burst_p99_us and burst_max_us are the same
+ * during the burst.
+ *
+ * Options:
+ *      -b alarms       Background alarms (default 1000)
+ *      -p period       Their period in ms (default 10)
+ *      -m size         Largest burst (default 1000000)
+ *      -j threads      Threads injecting each burst (default 1)
+ *      -w workers      Engine workers (default 0)
+ *      -q quiet        ms of quiet before each burst (default 500)
+ */
+#include <pthread.h>
+#include <stdatomic.h>
+#include <time.h>
+#include "errors.h"
+#include "alarm_engine.h"
+#include "alarm_sink.h"
+#include "histogram.h"
+
+#define MS              ((int64_t)1000000)
+#define SECOND          ((int64_t)1000000000)
+
+typedef struct injector_tag {
+    pthread_t           thread;
+    int                 first, last; /* Message numbers to inject */
+    int                 cancel;
+} injector_t;
+
+static alarm_engine_t *engine;
+static atomic_long lateness[2][HIST_BUCKETS]; /* Quiet, in a burst */
+static atomic_llong burst_max;
+static atomic_int in_burst;
+static atomic_int probe_fired;
+
+static int64_t real_now (void)
+{
+    struct timespec now;
+
+    clock_gettime (CLOCK_MONOTONIC, &now);
+    return (int64_t)now.tv_sec * SECOND + now.tv_nsec;
+}
+
+static void background_fire (alarm_entry_t *entry, void *payload)
+{
+    char line[128];
+    int64_t now = alarm_engine_now ();
+    int64_t late = now - alarm_entry_deadline (entry), max;
+    int burst = atomic_load (&in_burst), length;
+
+    (void)payload;
+    length = snprintf (line, sizeof (line),
+        "Alarm With Message Number (%d) Fired at <%lld>: <%lld ns late>\n",
+        alarm_entry_id (entry), (long long)now, (long long)late);
+    alarm_sink_write (line, length);
+    atomic_fetch_add_explicit (
+        &lateness[burst][hist_bucket (late)], 1, memory_order_relaxed);
+    if (burst) {
+        max = atomic_load (&burst_max);
+        while (late > max
+            && !atomic_compare_exchange_weak (&burst_max, &max, late))
+            ;
+    }
+}
+
+static void probe_fire (alarm_entry_t *entry, void *payload)
+{
+    (void)entry;
+    (void)payload;
+    atomic_store (&probe_fired, 1);
+}
+
+static void burst_fire (alarm_entry_t *entry, void *payload)
+{
+    (void)entry;
+    (void)payload;
+}
+
+static void schedule (int id, int64_t delay, int64_t period,
+    void (*fire)(alarm_entry_t*, void*))
+{
+    alarm_entry_t *entry;
+    int status;
+
+    entry = alarm_engine_alloc (engine);
+    if (entry == NULL) {
+        fprintf (stderr, "Engine pool exhausted\n");
+        exit (1);
+    }
+    entry->fire = fire;
+    status = alarm_engine_schedule (engine, entry, id, delay, period);
+    if (status != 0)
+        err_abort (status, "Schedule alarm");
+}
+
+/*
+ * Schedule, a minute out so that none fires, or cancel one slice of
+ * a burst.
+ */
+static void *injector_routine (void *arg)
+{
+    injector_t *injector = (injector_t*)arg;
+    int id;
+
+    for (id = injector->first; id <= injector->last; id++) {
+        if (injector->cancel)
+            alarm_engine_cancel (engine, id);
+        else
+            schedule (id, 60 * SECOND, 0, burst_fire);
+    }
+    return NULL;
+}
+
+static void snapshot (int burst, long *count)
+{
+    int i;
+
+    for (i = 0; i < HIST_BUCKETS; i++)
+        count[i] = atomic_exchange (&lateness[burst][i], 0);
+}
+
+int main (int argc, char *argv[])
+{
+    alarm_engine_attr_t attr;
+    injector_t *injectors;
+    static long base[HIST_BUCKETS], burst[HIST_BUCKETS];
+    int64_t period = 10 * MS, start, absorb;
+    int background = 1000, max_size = 1000000, threads = 1;
+    int workers = 0, quiet = 500, probe, size, cancel;
+    int option, status, i, slice;
+
+    while ((option = getopt (argc, argv, "b:p:m:j:w:q:")) != -1) {
+        switch (option) {
+        case 'b': background = atoi (optarg); break;
+        case 'p': period = (int64_t)(atof (optarg) * MS); break;
+        case 'm': max_size = atoi (optarg); break;
+        case 'j': threads = atoi (optarg); break;
+        case 'w': workers = atoi (optarg); break;
+        case 'q': quiet = atoi (optarg); break;
+        default:
+            fprintf (stderr, "usage: %s [-b alarms] [-p period] [-m size]"
+                " [-j threads] [-w workers] [-q quiet]\n", argv[0]);
+            exit (1);
+        }
+    }
+    if (background < 1 || max_size < 1 || threads < 1 || period <= 0) {
+        fprintf (stderr, "Counts and period must be positive\n");
+        exit (1);
+    }
+
+    alarm_engine_attr_init (&attr);
+    attr.capacity = background + max_size + 1;
+    attr.workers = workers;
+    status = alarm_engine_create (&engine, &attr);
+    if (status != 0)
+        err_abort (status, "Create engine");
+    injectors = (injector_t*)calloc (threads, sizeof (injector_t));
+    if (injectors == NULL)
+        errno_abort ("Allocate injectors");
+
+    /* Spread the background evenly over one period. */
+    for (i = 0; i < background; i++)
+        schedule (i + 1, period * i / background, period, background_fire);
+    probe = background + max_size + 1;
+
+    for (size = 10000; size <= max_size; size *= 10) {
+        for (cancel = 0; cancel <= 1; cancel++) {
+            usleep (quiet * 1000);
+            snapshot (0, base);
+            snapshot (1, burst);
+            atomic_store (&burst_max, 0);
+            atomic_store (&probe_fired, 0);
+
+            atomic_store (&in_burst, 1);
+            start = real_now ();
+            slice = (size + threads - 1) / threads;
+            for (i = 0; i < threads; i++) {
+                injectors[i].first = background + 1 + i * slice;
+                injectors[i].last = injectors[i].first + slice - 1;
+                if (injectors[i].last > background + size)
+                    injectors[i].last = background + size;
+                injectors[i].cancel = cancel;
+                status = pthread_create (&injectors[i].thread, NULL,
+                    injector_routine, &injectors[i]);
+                if (status != 0)
+                    err_abort (status, "Create injector");
+            }
+            for (i = 0; i < threads; i++) {
+                status = pthread_join (injectors[i].thread, NULL);
+                if (status != 0)
+                    err_abort (status, "Join injector");
+            }
+            schedule (probe, 0, 0, probe_fire);
+            while (!atomic_load (&probe_fired))
+                usleep (100);
+            absorb = real_now () - start;
+            atomic_store (&in_burst, 0);
+
+            snapshot (1, burst);
+            fprintf (stderr, "%s %s %d %.1f %.1f %.1f %.1f\n",
+                ALARM_VARIANT_NAME, cancel ? "cancel" : "insert", size,
+                (double)absorb / MS,
+                hist_percentile (base, 0.99) / 1000.0,
+                hist_percentile (burst, 0.99) / 1000.0,
+                atomic_load (&burst_max) / 1000.0);
+        }
+    }
+
+    status = alarm_engine_destroy (engine);
+    if (status != 0)
+        err_abort (status, "Destroy engine");
+    alarm_sink_flush ();
+    free (injectors);
+    return 0;
+}
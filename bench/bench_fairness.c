@@ -0,0 +1,217 @@
+/*
+ * bench_fairness.c
+ *
+ * Reader/writer fairness stress test of the alarm list's locking.
+ * Reader threads look alarms up under the read lock and now and then
+ * walk the whole list a page at a time, as print_alarm_list does;
+ * writer threads insert an alarm of their own and cancel it again,
+ * timing how long each alarm_insert and cancel_alarm call takes,
+ * which is almost all spent waiting for the lock (or, with the skip
+ * list index, retrying after other writers). After a fixed time
+ * it reports, one line on stderr:
+ *
+ *      readers writers seconds reads/s writes/s write_p50_us write_p99_us write_max_us
+ *
+ * A writer still waiting when time is up is counted with the wait it
+ * had when the readers stopped, so starvation shows as a maximum of
+ * about the run time. bench/fairness.sh runs it over a grid of
+ * reader and writer counts.
+ *
+ * Options:
+ *      -r readers      Reader threads (default 4)
+ *      -w writers      Writer threads (default 1)
+ *      -n size         Alarms on the list (default 1000)
+ *      -a percent      Reads that walk the whole list (default 10)
+ *      -d seconds      Run time (default 1)
+ */
+#include <pthread.h>
+#include <stdatomic.h>
+#include <time.h>
+#include "errors.h"
+#include "alarm_list.h"
+#include "histogram.h"
+
+#define SECOND          ((int64_t)1000000000)
+
+typedef struct worker_tag {
+    pthread_t           thread;
+    unsigned            seed;
+    long                ops;
+    int64_t             max_wait;
+    histogram_t         wait;
+} worker_t;
+
+static int size = 1000;
+static int walk_percent = 10;
+static atomic_int stop;
+
+static int64_t real_now (void)
+{
+    struct timespec now;
+
+    clock_gettime (CLOCK_MONOTONIC, &now);
+    return (int64_t)now.tv_sec * SECOND + now.tv_nsec;
+}
+
+static alarm_t *node_new (int message_number)
+{
+    alarm_t *alarm = (alarm_t*)calloc (1, sizeof (alarm_t));
+
+    if (alarm == NULL)
+        errno_abort ("Allocate alarm");
+    alarm->message_number = message_number;
+    alarm->seconds = 1;
+    alarm->time = time (NULL) + 1;
+    atomic_init (&alarm->state, ALARM_ACTIVE);
+    atomic_init (&alarm->refs, 1);
+    seqlock_init (&alarm->payload_lock);
+    alarm->deadline.index = -1;
+    strcpy (alarm->message, "fairness");
+    return alarm;
+}
+
+static void *reader_routine (void *arg)
+{
+    worker_t *reader = (worker_t*)arg;
+    alarm_summary_t page[ALARM_PAGE_SIZE];
+    alarm_cursor_t cursor;
+    volatile alarm_t *found;
+
+    while (!atomic_load_explicit (&stop, memory_order_relaxed)) {
+        if ((int)(rand_r (&reader->seed) % 100) < walk_percent) {
+            alarm_cursor_init (&cursor);
+            while (alarm_list_page (&cursor, page, ALARM_PAGE_SIZE) > 0)
+                ;
+        } else {
+            reader_enter ();
+            found = get_alarm_at (2 * (1 + rand_r (&reader->seed) % size));
+            reader_exit ();
+            (void)found;
+        }
+        reader->ops++;
+    }
+    return NULL;
+}
+
+static void writer_time (worker_t *writer, int64_t start)
+{
+    int64_t wait = real_now () - start;
+
+    writer->wait.count[hist_bucket (wait)]++;
+    if (wait > writer->max_wait)
+        writer->max_wait = wait;
+    writer->ops++;
+}
+
+/*
+ * Each writer has one alarm with an odd message number, so that it
+ * lands at a random place among the readers' even ones. (Two
+ * writers may pick the same number; cancel_alarm goes by node.)
+ */
+static void *writer_routine (void *arg)
+{
+    worker_t *writer = (worker_t*)arg;
+    alarm_t *alarm;
+    int64_t start;
+
+    alarm = node_new (2 * (rand_r (&writer->seed) % size) + 1);
+    while (!atomic_load_explicit (&stop, memory_order_relaxed)) {
+        start = real_now ();
+        alarm_insert (alarm);
+        writer_time (writer, start);
+        start = real_now ();
+        cancel_alarm (alarm);
+        writer_time (writer, start);
+    }
+    free (alarm);
+    return NULL;
+}
+
+int main (int argc, char *argv[])
+{
+    worker_t *readers, *writers;
+    static long wait[HIST_BUCKETS];
+    double seconds = 1.0, elapsed;
+    int64_t start, max_wait = 0;
+    long reads = 0, writes = 0;
+    int reader_count = 4, writer_count = 1;
+    int option, status, i, j;
+
+    while ((option = getopt (argc, argv, "r:w:n:a:d:")) != -1) {
+        switch (option) {
+        case 'r': reader_count = atoi (optarg); break;
+        case 'w': writer_count = atoi (optarg); break;
+        case 'n': size = atoi (optarg); break;
+        case 'a': walk_percent = atoi (optarg); break;
+        case 'd': seconds = atof (optarg); break;
+        default:
+            fprintf (stderr, "usage: %s [-r readers] [-w writers] [-n size]"
+                " [-a percent] [-d seconds]\n", argv[0]);
+            exit (1);
+        }
+    }
+    if (reader_count < 0 || writer_count < 0 || size < 1) {
+        fprintf (stderr, "Bad thread count or size\n");
+        exit (1);
+    }
+
+    /*
+     * Insert from the top down, so that each alarm goes at the head
+     * of a linked list.
+     */
+    alarm_list_init ();
+    for (i = size; i >= 1; i--)
+        alarm_insert (node_new (2 * i));
+
+    readers = (worker_t*)calloc (reader_count + 1, sizeof (worker_t));
+    writers = (worker_t*)calloc (writer_count + 1, sizeof (worker_t));
+    if (readers == NULL || writers == NULL)
+        errno_abort ("Allocate threads");
+    start = real_now ();
+    for (i = 0; i < reader_count; i++) {
+        readers[i].seed = i + 1;
+        status = pthread_create (
+            &readers[i].thread, NULL, reader_routine, &readers[i]);
+        if (status != 0)
+            err_abort (status, "Create reader");
+    }
+    for (i = 0; i < writer_count; i++) {
+        writers[i].seed = 1000 + i;
+        status = pthread_create (
+            &writers[i].thread, NULL, writer_routine, &writers[i]);
+        if (status != 0)
+            err_abort (status, "Create writer");
+    }
+    usleep ((useconds_t)(seconds * 1000000));
+
+    /*
+     * Stop the readers first and take the time, so a starved
+     * writer's last wait is not cut short by readers leaving.
+     */
+    atomic_store (&stop, 1);
+    for (i = 0; i < reader_count; i++) {
+        status = pthread_join (readers[i].thread, NULL);
+        if (status != 0)
+            err_abort (status, "Join reader");
+        reads += readers[i].ops;
+    }
+    elapsed = (double)(real_now () - start) / SECOND;
+    for (i = 0; i < writer_count; i++) {
+        status = pthread_join (writers[i].thread, NULL);
+        if (status != 0)
+            err_abort (status, "Join writer");
+        writes += writers[i].ops;
+        for (j = 0; j < HIST_BUCKETS; j++)
+            wait[j] += writers[i].wait.count[j];
+        if (writers[i].max_wait > max_wait)
+            max_wait = writers[i].max_wait;
+    }
+
+    fprintf (stderr, "%d %d %.2f %.0f %.0f %.1f %.1f %.1f\n",
+        reader_count, writer_count, elapsed, reads / elapsed,
+        writes / elapsed, hist_percentile (wait, 0.50) / 1000.0,
+        hist_percentile (wait, 0.99) / 1000.0, max_wait / 1000.0);
+    free (readers);
+    free (writers);
+    return 0;
+}
@@ -0,0 +1,161 @@
+/*
+ * bench_fanout.c
+ *
+ * Fan-out benchmark for the alarm engine: -n periodic alarms that
+ * share one period and one deadline, so that every tick they all
+ * fall due at once, as a fleet of clients polling on the same
+ * schedule does. Each callback does -k microseconds of work and
+ * writes one line through the output sink, naming its alarm and the
+ * tick, so the output of a run is the same from one run to the next
+ * exactly when the engine keeps it in order. After -t ticks it
+ * reports, one line on stderr:
+ *
+ *      variant alarms workers batch tick_ms max_tick_ms
+ *
+ * tick_ms is the mean time from a tick's deadline to its last
+ * callback returning, and max_tick_ms the longest. With -e, workers
+ * is the elastic pool's range, as "min..max", with max "cpus" for
+ * the CPU limit. bench/fanout.sh
+ * runs it with and without batching (alarm_engine_attr_t.batch) for
+ * a range of worker counts, and checks the output of each run
+ * against the first.
+ *
+ * Options:
+ *      -n alarms       Alarms (default 100000)
+ *      -p period       Their period in ms (default 1000)
+ *      -k work         Microseconds of work a callback (default 2)
+ *      -t ticks        Ticks to time (default 4)
+ *      -w workers      Engine workers (default 0)
+ *      -e max          Let the pool grow to max workers, or to the
+ *                      CPU limit for -1 (alarm_engine_attr_t.max_workers)
+ *      -b batch        Alarms a chunk of a batch, or 0 (default 0)
+ */
+#include <stdatomic.h>
+#include <time.h>
+#include "errors.h"
+#include "alarm_engine.h"
+#include "alarm_sink.h"
+
+#if ALARM_CLOCK == ALARM_CLOCK_VIRTUAL
+# error "bench_fanout times real work, and needs a real clock"
+#endif
+
+#define MS              ((int64_t)1000000)
+#define SECOND          ((int64_t)1000000000)
+
+static int64_t first_deadline, period, work;
+static int ticks = 4;
+static atomic_llong *last_fire; /* Latest callback return, each tick */
+static atomic_long fired;
+
+static void fanout_fire (alarm_entry_t *entry, void *payload)
+{
+    char line[128];
+    int64_t tick, start = alarm_engine_now (), now, last;
+    int length;
+
+    (void)payload;
+    /* Ticks after the last one timed may start before the end. */
+    tick = (alarm_entry_deadline (entry) - first_deadline) / period;
+    if (tick >= ticks)
+        return;
+    do
+        now = alarm_engine_now ();
+    while (now - start < work);
+    length = snprintf (line, sizeof (line),
+        "Alarm With Message Number (%d) Fired for Tick <%lld>\n",
+        alarm_entry_id (entry), (long long)tick);
+    alarm_sink_write (line, length);
+
+    last = atomic_load (&last_fire[tick]);
+    while (now > last
+        && !atomic_compare_exchange_weak (&last_fire[tick], &last, now))
+        ;
+    atomic_fetch_add (&fired, 1);
+}
+
+int main (int argc, char *argv[])
+{
+    alarm_engine_attr_t attr;
+    alarm_engine_t *engine;
+    alarm_entry_t *entry;
+    int64_t span, total = 0, longest = 0;
+    int alarms = 100000, workers = 0, batch = 0, max_workers = 0;
+    char range[32];
+    int option, status, i;
+
+    period = 1000 * MS;
+    work = 2000;
+    while ((option = getopt (argc, argv, "n:p:k:t:w:e:b:")) != -1) {
+        switch (option) {
+        case 'n': alarms = atoi (optarg); break;
+        case 'p': period = (int64_t)(atof (optarg) * MS); break;
+        case 'k': work = (int64_t)(atof (optarg) * 1000); break;
+        case 't': ticks = atoi (optarg); break;
+        case 'w': workers = atoi (optarg); break;
+        case 'e': max_workers = atoi (optarg); break;
+        case 'b': batch = atoi (optarg); break;
+        default:
+            fprintf (stderr, "usage: %s [-n alarms] [-p period] [-k work]"
+                " [-t ticks] [-w workers] [-e max] [-b batch]\n", argv[0]);
+            exit (1);
+        }
+    }
+    if (alarms < 1 || ticks < 1 || period <= 0 || workers < 0 || batch < 0) {
+        fprintf (stderr, "Counts and period must be positive\n");
+        exit (1);
+    }
+
+    last_fire = (atomic_llong*)calloc (ticks, sizeof (atomic_llong));
+    if (last_fire == NULL)
+        errno_abort ("Allocate ticks");
+    alarm_engine_attr_init (&attr);
+    attr.capacity = alarms;
+    attr.workers = workers;
+    attr.max_workers = max_workers;
+    attr.batch = batch;
+    status = alarm_engine_create (&engine, &attr);
+    if (status != 0)
+        err_abort (status, "Create engine");
+
+    /*
+     * Every alarm is aimed at the same instant, a second out, which
+     * leaves time to schedule them all.
+     */
+    first_deadline = alarm_engine_now () + SECOND;
+    for (i = 0; i < alarms; i++) {
+        entry = alarm_engine_alloc (engine);
+        if (entry == NULL)
+            err_abort (ENOMEM, "Allocate alarm");
+        entry->fire = fanout_fire;
+        status = alarm_engine_schedule_at (
+            engine, entry, i + 1, first_deadline, period);
+        if (status != 0)
+            err_abort (status, "Schedule alarm");
+    }
+
+    while (atomic_load (&fired) < (long)alarms * ticks)
+        usleep (1000);
+    status = alarm_engine_destroy (engine);
+    if (status != 0)
+        err_abort (status, "Destroy engine");
+    alarm_sink_flush ();
+
+    for (i = 0; i < ticks; i++) {
+        span = atomic_load (&last_fire[i]) - (first_deadline + i * period);
+        total += span;
+        if (span > longest)
+            longest = span;
+    }
+    if (max_workers == ALARM_ENGINE_CPUS)
+        snprintf (range, sizeof (range), "%d..cpus", workers);
+    else if (max_workers > 0)
+        snprintf (range, sizeof (range), "%d..%d", workers, max_workers);
+    else
+        snprintf (range, sizeof (range), "%d", workers);
+    fprintf (stderr, "%s %d %s %d %.2f %.2f\n", ALARM_VARIANT_NAME,
+        alarms, range, batch, (double)total / ticks / MS,
+        (double)longest / MS);
+    free (last_fire);
+    return 0;
+}
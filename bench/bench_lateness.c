@@ -0,0 +1,203 @@
+/*
+ * bench_lateness.c
+ *
+ * Lateness benchmark for the alarm engine, in particular its
+ * real-time mode (alarm_engine_attr_t.realtime). -n periodic alarms,
+ * their deadlines spread evenly over one -p period, fire for -d
+ * seconds while -l load threads keep every processor busy with
+ * ordinary work that also allocates and frees memory. Each callback
+ * records how late it ran after its deadline. At the end it reports,
+ * one line on stderr:
+ *
+ *      variant mode alarms load fires p50_us p99_us p9999_us max_us cpu_pct
+ *
+ * mode is "normal", or any of "realtime", "busy" and "spin", for -r,
+ * -b and -s, with a "+" between them. The percentiles are within
+ * 12.5% (see histogram.h); max_us is exact. cpu_pct is the CPU time
+ * the whole process took, as a percentage of the run time, so it
+ * only measures the engine's cost with no load threads.
+ *
+ * Options:
+ *      -n alarms       Alarms (default 100)
+ *      -p period       Their period in ms (default 10)
+ *      -d seconds      Run time (default 5)
+ *      -l load         Load threads (default twice the processors)
+ *      -w workers      Engine workers (default 0)
+ *      -r              Run the engine in real-time mode
+ *      -b              Use a busy-polling dispatcher
+ *      -s spin         Spin up to spin microseconds before each
+ *                      deadline (alarm_engine_attr_t.spin)
+ *      -c cpu          CPU to pin the dispatcher to, with -r
+ *      -P priority     The dispatcher's priority, with -r (default
+ *                      ALARM_ENGINE_PRIORITY)
+ */
+#include <sys/resource.h>
+#include <pthread.h>
+#include <stdatomic.h>
+#include <time.h>
+#include "errors.h"
+#include "alarm_config.h"
+#include "alarm_engine.h"
+#include "histogram.h"
+
+#if ALARM_CLOCK == ALARM_CLOCK_VIRTUAL
+# error "bench_lateness measures real lateness, and needs a real clock"
+#endif
+
+#define US              ((int64_t)1000)
+#define MS              ((int64_t)1000000)
+#define SECOND          ((int64_t)1000000000)
+
+static atomic_long late_hist[HIST_BUCKETS];
+static atomic_llong late_max;
+static atomic_int load_stop;
+
+static void lateness_fire (alarm_entry_t *entry, void *payload)
+{
+    int64_t late = alarm_engine_now () - alarm_entry_deadline (entry);
+    long long max = atomic_load (&late_max);
+
+    (void)payload;
+    atomic_fetch_add (&late_hist[hist_bucket (late)], 1);
+    while (late > max
+        && !atomic_compare_exchange_weak (&late_max, &max, late))
+        ;
+}
+
+/*
+ * A percentile of the lateness, in microseconds. The histogram gives
+ * the top of the percentile's bucket, which may be above the
+ * largest lateness seen.
+ */
+static double percentile_us (const long *counts, double percentile)
+{
+    int64_t value = hist_percentile (counts, percentile);
+
+    if (value > atomic_load (&late_max))
+        value = atomic_load (&late_max);
+    return (double)value / US;
+}
+
+/*
+ * A load thread: allocate, touch and free blocks of varying size
+ * until told to stop, so that the processors are busy and the heap
+ * and page tables are churned.
+ */
+static void *load_routine (void *arg)
+{
+    unsigned seed = (unsigned)(long)arg;
+    size_t size;
+    char *block;
+
+    while (!atomic_load (&load_stop)) {
+        size = 4096 + rand_r (&seed) % (256 * 1024);
+        block = (char*)malloc (size);
+        if (block == NULL)
+            errno_abort ("Allocate load");
+        memset (block, 1, size);
+        free (block);
+    }
+    return NULL;
+}
+
+int main (int argc, char *argv[])
+{
+    alarm_engine_attr_t attr;
+    alarm_engine_t *engine;
+    alarm_entry_t *entry;
+    pthread_t *load;
+    struct rusage usage;
+    long counts[HIST_BUCKETS], fires = 0;
+    char mode[32] = "";
+    int64_t first, start, elapsed, period = 10 * MS;
+    double seconds = 5;
+    int alarms = 100, loads, option, status, i;
+
+    alarm_engine_attr_init (&attr);
+    loads = 2 * (int)sysconf (_SC_NPROCESSORS_ONLN);
+    while ((option = getopt (argc, argv, "n:p:d:l:w:rbs:c:P:")) != -1) {
+        switch (option) {
+        case 'n': alarms = atoi (optarg); break;
+        case 'p': period = (int64_t)(atof (optarg) * MS); break;
+        case 'd': seconds = atof (optarg); break;
+        case 'l': loads = atoi (optarg); break;
+        case 'w': attr.workers = atoi (optarg); break;
+        case 'r': attr.realtime = 1; break;
+        case 'b': attr.busy_poll = 1; break;
+        case 's': attr.spin = (int64_t)(atof (optarg) * US); break;
+        case 'c': attr.cpu = atoi (optarg); break;
+        case 'P':
+            attr.priority = atoi (optarg);
+            attr.worker_priority = attr.priority - 1;
+            break;
+        default:
+            fprintf (stderr, "usage: %s [-n alarms] [-p period] [-d seconds]"
+                " [-l load] [-w workers] [-r] [-b] [-s spin] [-c cpu]"
+                " [-P priority]\n",
+                argv[0]);
+            exit (1);
+        }
+    }
+    if (alarms < 1 || period <= 0 || seconds <= 0 || loads < 0) {
+        fprintf (stderr, "Counts and times must be positive\n");
+        exit (1);
+    }
+
+    attr.capacity = alarms;
+    status = alarm_engine_create (&engine, &attr);
+    if (status != 0)
+        err_abort (status, "Create engine");
+
+    load = (pthread_t*)calloc (loads + 1, sizeof (pthread_t));
+    if (load == NULL)
+        errno_abort ("Allocate load threads");
+    for (i = 0; i < loads; i++) {
+        status = pthread_create (&load[i], NULL, load_routine, (void*)(long)i);
+        if (status != 0)
+            err_abort (status, "Create load thread");
+    }
+
+    first = alarm_engine_now () + 100 * MS;
+    for (i = 0; i < alarms; i++) {
+        entry = alarm_engine_alloc (engine);
+        if (entry == NULL)
+            err_abort (ENOMEM, "Allocate alarm");
+        entry->fire = lateness_fire;
+        status = alarm_engine_schedule_at (
+            engine, entry, i + 1, first + period * i / alarms, period);
+        if (status != 0)
+            err_abort (status, "Schedule alarm");
+    }
+
+    start = alarm_engine_now ();
+    usleep ((useconds_t)(seconds * 1000000));
+    elapsed = alarm_engine_now () - start;
+    getrusage (RUSAGE_SELF, &usage);
+    status = alarm_engine_destroy (engine);
+    if (status != 0)
+        err_abort (status, "Destroy engine");
+    atomic_store (&load_stop, 1);
+    for (i = 0; i < loads; i++)
+        pthread_join (load[i], NULL);
+    free (load);
+
+    for (i = 0; i < HIST_BUCKETS; i++) {
+        counts[i] = atomic_load (&late_hist[i]);
+        fires += counts[i];
+    }
+    if (attr.realtime)
+        strcat (mode, "+realtime");
+    if (attr.busy_poll)
+        strcat (mode, "+busy");
+    if (attr.spin > 0)
+        strcat (mode, "+spin");
+    fprintf (stderr, "%s %s %d %d %ld %.1f %.1f %.1f %.1f %.1f\n",
+        ALARM_VARIANT_NAME, mode[0] != '\0' ? mode + 1 : "normal",
+        alarms, loads, fires, percentile_us (counts, 0.5),
+        percentile_us (counts, 0.99), percentile_us (counts, 0.9999),
+        (double)atomic_load (&late_max) / US,
+        100.0 * ((usage.ru_utime.tv_sec + usage.ru_stime.tv_sec) * 1e6
+            + usage.ru_utime.tv_usec + usage.ru_stime.tv_usec)
+            / (elapsed / US));
+    return 0;
+}
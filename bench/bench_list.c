@@ -0,0 +1,291 @@
+/*
+ * bench_list.c
+ *
+ * Microbenchmark of the alarm list primitives of alarm_list.c, run
+ * directly from one thread: no display threads, no alarm thread and
+ * no waiting on real time. For each list size from 10 up to the
+ * maximum, in powers of ten, it times
+ *
+ *      get_alarm_at        lookup of an existing message number
+ *      message_id_exists   the same, through the existence test
+ *      alarm_insert        insert of a new message number
+ *      find_and_replace    replacement of an existing payload
+ *      cancel_alarm        removal of an existing alarm
+ *      next_deadline       extraction of the earliest deadline from
+ *                          due_heap, and its reinsertion a period on
+ *
+ * Each measurement is repeated, in batches long enough to time
+ * reliably, and reported as the mean cost per operation with a 95%
+ * confidence interval:
+ *
+ *      primitive size ns/op ci95 ops/batch
+ *
+ * Lists are built by linking nodes directly, in message number
+ * order, since building a large list through alarm_insert would
+ * take quadratic time (the skip list index is built through it).
+ * Message numbers in the list are even, so an odd number is never
+ * present.
+ *
+ * Options:
+ *      -m size         Largest list size (default 10000000)
+ *      -r samples      Batches per measurement (default 10)
+ *      -t usec         Minimum batch time (default 2000)
+ *      -s seed         Random seed (default 1)
+ */
+#include <math.h>
+#include <time.h>
+#include "errors.h"
+#include "alarm_list.h"
+
+static int samples = 10;
+static double batch_time = 0.002;
+static unsigned seed = 1;
+
+static alarm_t **nodes;         /* The list, in order */
+static int size;                /* Alarms on the list */
+static int *ids;                /* Random message numbers for a batch */
+static alarm_t **spare;         /* Nodes for alarm_insert */
+static alarm_t **victims;       /* Nodes for cancel_alarm */
+
+static double now (void)
+{
+    struct timespec ts;
+
+    clock_gettime (CLOCK_MONOTONIC, &ts);
+    return ts.tv_sec + ts.tv_nsec * 1e-9;
+}
+
+static alarm_t *node_new (int message_number, int seconds)
+{
+    alarm_t *alarm = (alarm_t*)calloc (1, sizeof (alarm_t));
+
+    if (alarm == NULL)
+        errno_abort ("Allocate alarm");
+    alarm->message_number = message_number;
+    alarm->seconds = seconds;
+    alarm->time = time (NULL) + seconds;
+    atomic_init (&alarm->state, ALARM_ACTIVE);
+    seqlock_init (&alarm->payload_lock);
+    alarm->deadline.key = message_number;
+    alarm->deadline.index = -1;
+    strcpy (alarm->message, "bench");
+    return alarm;
+}
+
+/*
+ * Grow (never shrink) the list to n alarms numbered 2, 4, ... 2n,
+ * linked in order (or inserted, into the skip list index), and queue
+ * each in due_heap.
+ */
+static void list_build (int n)
+{
+    int i, status;
+
+    nodes = (alarm_t**)realloc (nodes, n * sizeof (alarm_t*));
+    if (nodes == NULL)
+        errno_abort ("Allocate list");
+    for (i = size; i < n; i++) {
+        nodes[i] = node_new (2 * (i + 1), 1 + rand_r (&seed) % 3600);
+#if ALARM_INDEX == ALARM_INDEX_LIST
+        if (i > 0)
+            nodes[i - 1]->link = nodes[i];
+#else
+        alarm_insert (nodes[i]);
+#endif
+        nodes[i]->deadline.deadline = nodes[i]->time;
+        status = deadline_heap_push (&due_heap, &nodes[i]->deadline);
+        if (status != 0)
+            err_abort (status, "Queue deadline");
+    }
+#if ALARM_INDEX == ALARM_INDEX_LIST
+    if (n > 0)
+        nodes[n - 1]->link = NULL;
+    alarm_list = n > 0 ? nodes[0] : NULL;
+#endif
+    size = n;
+}
+
+static void random_ids (int count)
+{
+    int i;
+
+    for (i = 0; i < count; i++)
+        ids[i] = 2 * (1 + rand_r (&seed) % size);
+}
+
+static volatile long sink;
+
+/*
+ * Run one batch of count operations of primitive, with whatever
+ * setup and cleanup it needs done outside the timed region, and
+ * return the time taken.
+ */
+static double run_batch (const char *primitive, int count)
+{
+    alarm_t replacement, *alarm;
+    deadline_node_t *node;
+    double start, elapsed;
+    int stride = size / count, base, i;
+
+    if (strcmp (primitive, "get_alarm_at") == 0) {
+        random_ids (count);
+        start = now ();
+        for (i = 0; i < count; i++)
+            sink += get_alarm_at (ids[i])->seconds;
+        return now () - start;
+    } else if (strcmp (primitive, "message_id_exists") == 0) {
+        random_ids (count);
+        start = now ();
+        for (i = 0; i < count; i++)
+            sink += message_id_exists (ids[i]);
+        return now () - start;
+    } else if (strcmp (primitive, "alarm_insert") == 0) {
+        /*
+         * Distinct odd numbers, so the new alarms are all absent;
+         * they are taken out again after the timed region.
+         */
+        base = rand_r (&seed) % size;
+        for (i = 0; i < count; i++)
+            spare[i]->message_number = 2 * ((base + i * stride) % size) + 1;
+        start = now ();
+        for (i = 0; i < count; i++)
+            alarm_insert (spare[i]);
+        elapsed = now () - start;
+        for (i = 0; i < count; i++)
+            cancel_alarm (spare[i]);
+        return elapsed;
+    } else if (strcmp (primitive, "find_and_replace") == 0) {
+        random_ids (count);
+        memset (&replacement, 0, sizeof (replacement));
+        replacement.seconds = 5;
+        strcpy (replacement.message, "replaced");
+        start = now ();
+        for (i = 0; i < count; i++) {
+            replacement.message_number = ids[i];
+            find_and_replace (&replacement);
+        }
+        return now () - start;
+    } else if (strcmp (primitive, "cancel_alarm") == 0) {
+        /*
+         * Distinct nodes, spread over the list and taken in random
+         * order, put back after the timed region.
+         */
+        for (i = 0; i < count; i++)
+            victims[i] = nodes[stride * i + rand_r (&seed) % stride];
+        for (i = count - 1; i > 0; i--) {
+            base = rand_r (&seed) % (i + 1);
+            alarm = victims[i];
+            victims[i] = victims[base];
+            victims[base] = alarm;
+        }
+        start = now ();
+        for (i = 0; i < count; i++)
+            cancel_alarm (victims[i]);
+        elapsed = now () - start;
+        for (i = 0; i < count; i++)
+            alarm_insert (victims[i]);
+        return elapsed;
+    } else {
+        start = now ();
+        for (i = 0; i < count; i++) {
+            node = deadline_heap_pop (&due_heap);
+            alarm = nodes[node->key / 2 - 1];
+            node->deadline += alarm->seconds;
+            deadline_heap_push (&due_heap, node);
+        }
+        return now () - start;
+    }
+}
+
+/*
+ * Student's t for a two-sided 95% interval with n - 1 degrees of
+ * freedom.
+ */
+static double t95 (int n)
+{
+    static const double table[] = { 0, 12.71, 4.30, 3.18, 2.78, 2.57,
+        2.45, 2.36, 2.31, 2.26, 2.23, 2.20, 2.18, 2.16, 2.14, 2.13,
+        2.12, 2.11, 2.10, 2.09, 2.09 };
+
+    if (n - 1 < (int)(sizeof (table) / sizeof (table[0])))
+        return table[n - 1];
+    return 1.96;
+}
+
+static void measure (const char *primitive)
+{
+    double times[256], mean = 0, var = 0, elapsed;
+    int count = 1, i, limit;
+
+    /*
+     * Batches of cancel_alarm and alarm_insert use distinct alarms,
+     * so they are kept to half the list, or they would mostly work
+     * on an empty or doubled list.
+     */
+    limit = 1 << 20;
+    if (strcmp (primitive, "alarm_insert") == 0
+        || strcmp (primitive, "cancel_alarm") == 0)
+        limit = size / 2 > 0 ? size / 2 : 1;
+    while ((elapsed = run_batch (primitive, count)) < batch_time
+        && count < limit)
+        count = count * 2 > limit ? limit : count * 2;
+
+    for (i = 0; i < samples; i++) {
+        times[i] = run_batch (primitive, count) / count * 1e9;
+        mean += times[i];
+    }
+    mean /= samples;
+    for (i = 0; i < samples; i++)
+        var += (times[i] - mean) * (times[i] - mean);
+    if (samples > 1)
+        var /= samples - 1;
+    printf ("%-18s %9d %12.1f %10.1f %8d\n", primitive, size, mean,
+        t95 (samples) * sqrt (var / samples), count);
+    fflush (stdout);
+}
+
+int main (int argc, char *argv[])
+{
+    static const char *primitives[] = { "get_alarm_at",
+        "message_id_exists", "alarm_insert", "find_and_replace",
+        "cancel_alarm", "next_deadline", NULL };
+    int max = 10000000, option, n, i;
+
+    while ((option = getopt (argc, argv, "m:r:t:s:")) != -1) {
+        switch (option) {
+        case 'm': max = atoi (optarg); break;
+        case 'r': samples = atoi (optarg); break;
+        case 't': batch_time = atof (optarg) * 1e-6; break;
+        case 's': seed = atoi (optarg); break;
+        default:
+            fprintf (stderr, "usage: %s [-m size] [-r samples]"
+                " [-t usec] [-s seed]\n", argv[0]);
+            exit (1);
+        }
+    }
+    if (samples < 2 || samples > 256) {
+        fprintf (stderr, "samples must be between 2 and 256\n");
+        exit (1);
+    }
+
+    alarm_list_init ();
+    ids = (int*)malloc ((1 << 20) * sizeof (int));
+    spare = (alarm_t**)calloc (1 << 20, sizeof (alarm_t*));
+    victims = (alarm_t**)malloc ((1 << 20) * sizeof (alarm_t*));
+    if (ids == NULL || spare == NULL || victims == NULL)
+        errno_abort ("Allocate batch");
+
+    printf ("%-18s %9s %12s %10s %8s\n",
+        "primitive", "size", "ns/op", "ci95", "ops");
+    for (n = 10; n <= max; n *= 10) {
+        list_build (n);
+        for (i = 0; i < n && i < (1 << 20); i++)
+            if (spare[i] == NULL)
+                spare[i] = node_new (1, 1);
+        for (i = 0; primitives[i] != NULL; i++)
+            measure (primitives[i]);
+        if (n > max / 10)
+            break;
+    }
+    return 0;
+}
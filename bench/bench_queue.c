@@ -0,0 +1,150 @@
+/*
+ * bench_queue.c
+ *
+ * Hold-model benchmark of the engine's deadline queue (alarm_queue.h)
+ * on its own, from one thread. The queue is filled with size alarms
+ * due at random within the first second; then, as the dispatcher
+ * does with periodic alarms, each operation pops the earliest alarm
+ * and pushes it back with its deadline moved on by a random period
+ * of up to a second (or, with -p, a period spread evenly over the
+ * orders of magnitude from a tenth of a second to max). It runs for ops operations or until the time
+ * limit, whichever comes first, and reports, one line on stderr:
+ *
+ *      queue size ops seconds ns/op
+ *
+ * bench/queue.sh runs it against every queue.
+ *
+ * Options:
+ *      -n size         Alarms in the queue (default 1000000)
+ *      -o ops          Operations (default 10000000)
+ *      -d seconds      Time limit (default 10)
+ *      -s seed         Random seed (default 1)
+ *      -p max          Spread periods from 0.1 to max seconds
+ */
+#include <math.h>
+#include <time.h>
+#include "errors.h"
+#include "alarm_queue.h"
+
+#define SECOND          ((int64_t)1000000000)
+
+static int64_t real_now (void)
+{
+    struct timespec now;
+
+    clock_gettime (CLOCK_MONOTONIC, &now);
+    return (int64_t)now.tv_sec * SECOND + now.tv_nsec;
+}
+
+/* A random time of up to a second, in nanoseconds. */
+static int64_t random_time (unsigned *seed)
+{
+    return ((int64_t)rand_r (seed) << 15 ^ rand_r (seed)) % SECOND;
+}
+
+/*
+ * A random period from a tenth of a second to max seconds, as
+ * likely to fall in any one decade of that range as in another.
+ */
+static int64_t random_period (unsigned *seed, double max)
+{
+    double fraction = (double)rand_r (seed) / RAND_MAX;
+
+    return (int64_t)(0.1 * pow (max / 0.1, fraction) * SECOND);
+}
+
+static int time_compare (const void *a, const void *b)
+{
+    int64_t x = *(int64_t*)a, y = *(int64_t*)b;
+
+    return x < y ? -1 : x > y;
+}
+
+int main (int argc, char *argv[])
+{
+    alarm_queue_t *queue;
+    deadline_node_t *nodes, *node;
+    int64_t *deadlines;
+    double seconds = 10.0, spread = 0.0;
+    int64_t start, limit, elapsed, check, now;
+    long ops = 10000000, done, next_check = 0, stride = 1;
+    unsigned seed = 1;
+    int size = 1000000, option, status, i;
+
+    while ((option = getopt (argc, argv, "n:o:d:s:p:")) != -1) {
+        switch (option) {
+        case 'n': size = atoi (optarg); break;
+        case 'o': ops = atol (optarg); break;
+        case 'd': seconds = atof (optarg); break;
+        case 's': seed = atoi (optarg); break;
+        case 'p': spread = atof (optarg); break;
+        default:
+            fprintf (stderr, "usage: %s [-n size] [-o ops] [-d seconds]"
+                " [-s seed] [-p max]\n", argv[0]);
+            exit (1);
+        }
+    }
+    if (size < 1 || ops < 1 || (spread != 0.0 && spread <= 0.1)) {
+        fprintf (stderr, "Size and ops must be positive, max over 0.1\n");
+        exit (1);
+    }
+
+    queue = (alarm_queue_t*)malloc (sizeof (alarm_queue_t));
+    nodes = (deadline_node_t*)calloc (size, sizeof (deadline_node_t));
+    deadlines = (int64_t*)malloc (size * sizeof (int64_t));
+    if (queue == NULL || nodes == NULL || deadlines == NULL)
+        errno_abort ("Allocate queue");
+    status = alarm_queue_init (queue, size);
+    if (status != 0)
+        err_abort (status, "Initialize queue");
+    /*
+     * Deadlines are dealt out in order, so that the sorted list
+     * fills in linear time.
+     */
+    for (i = 0; i < size; i++)
+        deadlines[i] = spread > 0.0 ? random_period (&seed, spread)
+            : random_time (&seed);
+    qsort (deadlines, size, sizeof (int64_t), time_compare);
+    for (i = 0; i < size; i++) {
+        nodes[i].key = i + 1;
+        nodes[i].deadline = deadlines[i];
+        status = alarm_queue_push (queue, &nodes[i]);
+        if (status != 0)
+            err_abort (status, "Queue alarm");
+    }
+    free (deadlines);
+
+    /*
+     * The clock is read every stride operations, and the stride
+     * doubles (up to 1024) while one takes under a millisecond, so
+     * that the faster queues are not timing clock_gettime and the
+     * slower ones still stop on time.
+     */
+    start = check = real_now ();
+    limit = start + (int64_t)(seconds * SECOND);
+    for (done = 0; done < ops; done++) {
+        if (done == next_check) {
+            now = real_now ();
+            if (now > limit)
+                break;
+            if (now - check < SECOND / 1000 && stride < 1024)
+                stride *= 2;
+            check = now;
+            next_check = done + stride;
+        }
+        node = alarm_queue_pop (queue);
+        node->deadline += spread > 0.0 ? random_period (&seed, spread)
+            : 1 + random_time (&seed);
+        status = alarm_queue_push (queue, node);
+        if (status != 0)
+            err_abort (status, "Requeue alarm");
+    }
+    elapsed = real_now () - start;
+
+    fprintf (stderr, "%s %d %ld %.2f %.1f\n", ALARM_QUEUE_NAME, size, done,
+        (double)elapsed / SECOND, (double)elapsed / done);
+    alarm_queue_destroy (queue);
+    free (nodes);
+    free (queue);
+    return 0;
+}
@@ -0,0 +1,220 @@
+/*
+ * bench_scaling.c
+ *
+ * Thread-scaling benchmark for the alarm engine. A number of
+ * producer threads schedule and cancel short one-shot alarms as
+ * fast as they can, while the engine's workers run the callbacks,
+ * which format a display line and write it to the output sink.
+ * After a fixed time it reports, one line on stderr:
+ *
+ *      variant producers workers seconds ops ops/s fires op_p99_ns fire_p99_ns
+ *
+ * ops counts schedules, cancels and fires. op_p99_ns is the 99th
+ * percentile time of one schedule or cancel call, as the producer
+ * sees it; fire_p99_ns is the 99th percentile of how late callbacks
+ * ran after their deadline. Nothing advances the virtual clock
+ * here, so built with CLOCK=virtual it times the calls alone.
+ *
+ * Options:
+ *      -p producers    Producer threads (default 1)
+ *      -w workers      Engine workers; 0 runs callbacks on the
+ *                      dispatcher (default 1)
+ *      -d seconds      Run time (default 1)
+ *      -c capacity     Engine capacity (default 65536)
+ *      -s seed         Random seed (default 1)
+ */
+#include <pthread.h>
+#include <stdatomic.h>
+#include <time.h>
+#include "errors.h"
+#include "alarm_engine.h"
+#include "alarm_sink.h"
+#include "histogram.h"
+
+#define US              ((int64_t)1000)
+#define SECOND          ((int64_t)1000000000)
+
+/*
+ * Real time, for throughput and call latency even when the engine
+ * runs on the virtual clock.
+ */
+static int64_t real_now (void)
+{
+    struct timespec now;
+
+    clock_gettime (CLOCK_MONOTONIC, &now);
+    return (int64_t)now.tv_sec * SECOND + now.tv_nsec;
+}
+
+typedef struct producer_tag {
+    pthread_t           thread;
+    int                 index;
+    unsigned            seed;
+    long                schedules, cancels;
+    histogram_t         latency;
+} producer_t;
+
+static alarm_engine_t *engine;
+static int producer_count = 1;
+static int capacity = 65536;
+static atomic_long fire_hist[HIST_BUCKETS];
+static atomic_long fires;
+static atomic_int stop;
+
+static void scaling_fire (alarm_entry_t *entry, void *payload)
+{
+    char line[128];
+    int64_t now = alarm_engine_now ();
+    int64_t late = now - alarm_entry_deadline (entry);
+    int length;
+
+    (void)payload;
+    length = snprintf (line, sizeof (line),
+        "Alarm With Message Number (%d) Fired at <%lld>: <%lld ns late>\n",
+        alarm_entry_id (entry), (long long)now, (long long)late);
+    alarm_sink_write (line, length);
+    atomic_fetch_add_explicit (
+        &fire_hist[hist_bucket (late)], 1, memory_order_relaxed);
+    atomic_fetch_add_explicit (&fires, 1, memory_order_relaxed);
+}
+
+/*
+ * Each producer owns the message numbers congruent to its index,
+ * and keeps a ring of the last ones it scheduled to pick cancel
+ * victims from. A quarter of its operations are cancels, which
+ * often find the alarm has already fired.
+ */
+static void *producer_routine (void *arg)
+{
+    producer_t *producer = (producer_t*)arg;
+    alarm_entry_t *entry;
+    int64_t start, delay;
+    int ring_size = capacity / producer_count, *ring;
+    int ring_count = 0, next = 0, id, status;
+
+    if (ring_size < 1)
+        ring_size = 1;
+    ring = (int*)malloc (ring_size * sizeof (int));
+    if (ring == NULL)
+        errno_abort ("Allocate producer");
+
+    while (!atomic_load_explicit (&stop, memory_order_relaxed)) {
+        if (ring_count > 0 && rand_r (&producer->seed) % 4 == 0) {
+            id = ring[rand_r (&producer->seed) % ring_count];
+            start = real_now ();
+            alarm_engine_cancel (engine, id);
+            producer->latency.count[
+                hist_bucket (real_now () - start)]++;
+            producer->cancels++;
+            continue;
+        }
+
+        start = real_now ();
+        entry = alarm_engine_alloc (engine);
+        if (entry == NULL) {
+            sched_yield ();
+            continue;
+        }
+        entry->fire = scaling_fire;
+        delay = (int64_t)((double)rand_r (&producer->seed) / RAND_MAX
+            * 1000 * US);
+        id = producer->index + next * producer_count;
+        status = alarm_engine_schedule (engine, entry, id, delay, 0);
+        if (status != 0)
+            err_abort (status, "Schedule alarm");
+        producer->latency.count[hist_bucket (real_now () - start)]++;
+        producer->schedules++;
+
+        if (ring_count < ring_size)
+            ring_count++;
+        ring[next % ring_size] = id;
+        if (++next >= (0x7fffffff - producer_count) / producer_count)
+            next = 0;
+    }
+    free (ring);
+    return NULL;
+}
+
+int main (int argc, char *argv[])
+{
+    alarm_engine_attr_t attr;
+    producer_t *producers;
+    static long op_hist[HIST_BUCKETS];
+    double seconds = 1.0, elapsed;
+    int64_t start;
+    long schedules = 0, cancels = 0, fired, ops;
+    unsigned seed = 1;
+    int worker_count = 1;
+    int option, status, i, j;
+
+    while ((option = getopt (argc, argv, "p:w:d:c:s:")) != -1) {
+        switch (option) {
+        case 'p': producer_count = atoi (optarg); break;
+        case 'w': worker_count = atoi (optarg); break;
+        case 'd': seconds = atof (optarg); break;
+        case 'c': capacity = atoi (optarg); break;
+        case 's': seed = atoi (optarg); break;
+        default:
+            fprintf (stderr, "usage: %s [-p producers] [-w workers]"
+                " [-d seconds] [-c capacity] [-s seed]\n", argv[0]);
+            exit (1);
+        }
+    }
+    if (producer_count < 1 || worker_count < 0) {
+        fprintf (stderr, "Need at least one producer\n");
+        exit (1);
+    }
+
+    alarm_engine_attr_init (&attr);
+    attr.capacity = capacity;
+    attr.workers = worker_count;
+    status = alarm_engine_create (&engine, &attr);
+    if (status != 0)
+        err_abort (status, "Create engine");
+    producers = (producer_t*)calloc (producer_count, sizeof (producer_t));
+    if (producers == NULL)
+        errno_abort ("Allocate producers");
+
+    start = real_now ();
+    for (i = 0; i < producer_count; i++) {
+        producers[i].index = i + 1;
+        producers[i].seed = seed + i;
+        status = pthread_create (
+            &producers[i].thread, NULL, producer_routine, &producers[i]);
+        if (status != 0)
+            err_abort (status, "Create producer");
+    }
+    usleep ((useconds_t)(seconds * 1000000));
+    atomic_store (&stop, 1);
+    for (i = 0; i < producer_count; i++) {
+        status = pthread_join (producers[i].thread, NULL);
+        if (status != 0)
+            err_abort (status, "Join producer");
+        schedules += producers[i].schedules;
+        cancels += producers[i].cancels;
+        for (j = 0; j < HIST_BUCKETS; j++)
+            op_hist[j] += producers[i].latency.count[j];
+    }
+    elapsed = (double)(real_now () - start) / SECOND;
+    fired = atomic_load (&fires);
+
+    status = alarm_engine_destroy (engine);
+    if (status != 0)
+        err_abort (status, "Destroy engine");
+    alarm_sink_flush ();
+
+    /*
+     * Fires that were still running when the producers stopped are
+     * in the histogram too; it doesn't matter for a percentile.
+     */
+    for (j = 0; j < HIST_BUCKETS; j++)
+        producers[0].latency.count[j] = atomic_load (&fire_hist[j]);
+    ops = schedules + cancels + fired;
+    fprintf (stderr, "%s %d %d %.2f %ld %.0f %ld %lld %lld\n",
+        ALARM_VARIANT_NAME, producer_count, worker_count, elapsed, ops,
+        ops / elapsed, fired,
+        (long long)hist_percentile (op_hist, 0.99),
+        (long long)hist_percentile (producers[0].latency.count, 0.99));
+    free (producers);
+    return 0;
+}
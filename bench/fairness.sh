@@ -0,0 +1,27 @@
+#!/bin/sh
+#
+# fairness.sh
+#
+# Run the reader/writer fairness test for every combination of
+# reader and writer counts, printing one line per run (see
+# bench_fairness.c for the columns). Run from the top of the tree,
+# usually as "make bench-fairness".
+#
+# Environment:
+#       READERS WRITERS     Thread counts (default 0 1 2 4 8 16 32 and 1 2 4 8)
+#       DURATION            Seconds per run (default 1)
+#       FLAGS               Other bench_fairness options, e.g. "-n 10000"
+#       PROGRAM             The benchmark (default build/index-list/bench_fairness)
+
+READERS=${READERS:-"0 1 2 4 8 16 32"}
+WRITERS=${WRITERS:-"1 2 4 8"}
+DURATION=${DURATION:-1}
+PROGRAM=${PROGRAM:-build/index-list/bench_fairness}
+
+echo "readers writers seconds reads/s writes/s write_p50_us write_p99_us write_max_us"
+for writers in $WRITERS; do
+  for readers in $READERS; do
+    $PROGRAM -r $readers -w $writers -d $DURATION $FLAGS 2>&1 \
+        || exit 1
+  done
+done
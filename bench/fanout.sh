@@ -0,0 +1,57 @@
+#!/bin/sh
+#
+# fanout.sh
+#
+# Build the fan-out benchmark and run it for each worker count, and
+# then with an elastic pool for each limit in ELASTIC, first
+# firing each tick's alarms one at a time and then in batches,
+# printing one line per run (see bench_fanout.c for the columns),
+# with a last column that says whether the run's output is the same
+# as that of the first run, on the dispatcher alone. Run from the
+# top of the tree, usually as "make bench-fanout".
+#
+# Environment:
+#       QUEUE LOCK SINK     Components (default heap, sem, buffer)
+#       WORKERS             Worker counts (default 0 1 2 4 8)
+#       ELASTIC             Elastic pool limits, -1 for the CPU limit
+#                           (default -1 8); each pool starts empty
+#       BATCH               Alarms a chunk when batching (default 256)
+#       ALARMS WORK TICKS   bench_fanout -n, -k and -t (default 100000,
+#                           2 and 4)
+#       OPT                 Optimization flags (default -O2)
+
+QUEUE=${QUEUE:-heap}
+LOCK=${LOCK:-sem}
+SINK=${SINK:-buffer}
+WORKERS=${WORKERS:-"0 1 2 4 8"}
+ELASTIC=${ELASTIC:-"-1 8"}
+BATCH=${BATCH:-256}
+ALARMS=${ALARMS:-100000}
+WORK=${WORK:-2}
+TICKS=${TICKS:-4}
+OPT=${OPT:-"-O2"}
+
+variant=$QUEUE-$LOCK-monotonic-$SINK
+make -s build/$variant/bench_fanout QUEUE=$QUEUE LOCK=$LOCK \
+    SINK=$SINK OPT="$OPT" >&2 || exit 1
+
+echo "variant alarms workers batch tick_ms max_tick_ms output"
+reference=
+for batch in 0 $BATCH; do
+  for pool in $WORKERS $(for max in $ELASTIC; do echo "0,$max"; done); do
+    case $pool in
+    *,*)    flags="-w ${pool%,*} -e ${pool#*,}" ;;
+    *)      flags="-w $pool" ;;
+    esac
+    result=$(build/$variant/bench_fanout -n $ALARMS -k $WORK -t $TICKS \
+        $flags -b $batch 2>&1 >build/fanout.out) || exit 1
+    sum=$(cksum < build/fanout.out)
+    reference=${reference:-$sum}
+    if [ "$sum" = "$reference" ]; then
+      echo "$result same"
+    else
+      echo "$result differs"
+    fi
+  done
+done
+rm -f build/fanout.out
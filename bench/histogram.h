@@ -0,0 +1,56 @@
+#ifndef __histogram_h
+#define __histogram_h
+
+#include <stdint.h>
+
+/*
+ * Latency histograms for the benchmarks: exact below 8 ns, then 8
+ * buckets per power of two, so any percentile is within 12.5%.
+ */
+#define HIST_BUCKETS    (62 * 8)
+
+typedef struct histogram_tag {
+    long                count[HIST_BUCKETS];
+} histogram_t;
+
+static inline int hist_bucket (int64_t value)
+{
+    int msb;
+
+    if (value < 8)
+        return value < 0 ? 0 : (int)value;
+    msb = 63 - __builtin_clzll ((unsigned long long)value);
+    return (msb - 2) * 8 + (int)((value >> (msb - 3)) & 7);
+}
+
+/*
+ * The largest value that falls in bucket.
+ */
+static inline int64_t hist_value (int bucket)
+{
+    int msb;
+
+    if (bucket < 8)
+        return bucket;
+    msb = bucket / 8 + 2;
+    return ((int64_t)(8 + bucket % 8 + 1) << (msb - 3)) - 1;
+}
+
+static inline int64_t hist_percentile (const long *count, double percentile)
+{
+    long total = 0, seen = 0;
+    int i;
+
+    for (i = 0; i < HIST_BUCKETS; i++)
+        total += count[i];
+    if (total == 0)
+        return 0;
+    for (i = 0; i < HIST_BUCKETS; i++) {
+        seen += count[i];
+        if (seen >= total * percentile)
+            return hist_value (i);
+    }
+    return hist_value (HIST_BUCKETS - 1);
+}
+
+#endif
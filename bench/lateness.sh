@@ -0,0 +1,56 @@
+#!/bin/sh
+#
+# lateness.sh
+#
+# Build the lateness benchmark and run it with the engine in each of
+# MODES, first idle and then under load, printing one line per run
+# (see bench_lateness.c for the columns). Real-time mode needs the privileges to lock memory and set SCHED_FIFO, so
+# run as root, or with CAP_SYS_NICE and CAP_IPC_LOCK. Run from the
+# top of the tree, usually as "make bench-lateness".
+#
+# Environment:
+#       QUEUE LOCK          Components (default heap, sem)
+#       MODES               Any of normal, realtime, busy (a polling
+#                           dispatcher), spin (early wake, then spin),
+#                           realtime+busy, which needs CPU, and
+#                           realtime+spin (default normal spin
+#                           realtime realtime+spin busy)
+#       SPIN                Most microseconds to spin (default 200)
+#       LOADS               Load thread counts (default 0 and twice
+#                           the processors)
+#       ALARMS PERIOD       bench_lateness -n and -p (default 100, 10)
+#       DURATION            Seconds per run (default 5)
+#       CPU                 Dispatcher CPU in real-time modes (default
+#                           none)
+#       OPT                 Optimization flags (default -O2)
+
+QUEUE=${QUEUE:-heap}
+LOCK=${LOCK:-sem}
+MODES=${MODES:-"normal spin realtime realtime+spin busy"}
+SPIN=${SPIN:-200}
+LOADS=${LOADS:-"0 $((2 * $(getconf _NPROCESSORS_ONLN)))"}
+ALARMS=${ALARMS:-100}
+PERIOD=${PERIOD:-10}
+DURATION=${DURATION:-5}
+OPT=${OPT:-"-O2"}
+
+variant=$QUEUE-$LOCK-monotonic-null
+make -s build/$variant/bench_lateness QUEUE=$QUEUE LOCK=$LOCK \
+    SINK=null OPT="$OPT" >&2 || exit 1
+
+echo "variant mode alarms load fires p50_us p99_us p9999_us max_us cpu_pct"
+for load in $LOADS; do
+  for mode in $MODES; do
+    case $mode in
+    normal)         flags= ;;
+    realtime)       flags="-r ${CPU:+-c $CPU}" ;;
+    busy)           flags=-b ;;
+    spin)           flags="-s $SPIN" ;;
+    realtime+busy)  flags="-r -b -c ${CPU:-0}" ;;
+    realtime+spin)  flags="-r -s $SPIN ${CPU:+-c $CPU}" ;;
+    *)              echo "Unknown mode $mode" >&2; exit 1 ;;
+    esac
+    build/$variant/bench_lateness -n $ALARMS -p $PERIOD -d $DURATION \
+        -l $load $flags 2>&1 || exit 1
+  done
+done
@@ -0,0 +1,40 @@
+#!/bin/sh
+#
+# matrix.sh
+#
+# Build the load generator for every combination of engine
+# components and run each workload mix against it, printing one
+# line per run (see alarm_loadgen.c for the columns). Run from the
+# top of the tree, usually as "make bench-matrix".
+#
+# Environment:
+#       QUEUES LOCKS CLOCKS SINKS   Components to cover (default all)
+#       MIXES                       Workload mixes (default all)
+#       DURATION                    Seconds per run (default 1)
+#       READERS                     Query threads per run (default 1)
+#       OPT                         Optimization flags (default -O2)
+
+QUEUES=${QUEUES:-"list heap wheel radix hybrid"}
+LOCKS=${LOCKS:-"sem rwlock brlock"}
+CLOCKS=${CLOCKS:-"monotonic coarse realtime virtual"}
+SINKS=${SINKS:-"stdout buffer null"}
+MIXES=${MIXES:-"insert cancel fire"}
+DURATION=${DURATION:-1}
+READERS=${READERS:-1}
+OPT=${OPT:-"-O2"}
+
+echo "variant mix seconds ops ops/s schedules cancels fires queries"
+for queue in $QUEUES; do
+  for lock in $LOCKS; do
+    for clock in $CLOCKS; do
+      for sink in $SINKS; do
+        make -s loadgen QUEUE=$queue LOCK=$lock CLOCK=$clock SINK=$sink \
+            OPT="$OPT" >&2 || exit 1
+        for mix in $MIXES; do
+          build/$queue-$lock-$clock-$sink/alarm_loadgen \
+              -m $mix -d $DURATION -r $READERS 2>&1 >/dev/null || exit 1
+        done
+      done
+    done
+  done
+done
@@ -0,0 +1,70 @@
+#!/bin/sh
+#
+# pgo.sh
+#
+# Profile-guided, link-time optimized build of the engine and the
+# load generator, for one engine variant. Run from the top of the
+# tree, usually as "make pgo [QUEUE=... LOCK=... CLOCK=... SINK=...]".
+#
+#   1. Build an instrumented load generator (-fprofile-generate).
+#   2. Train it on the insert-, cancel- and fire-heavy mixes.
+#   3. Rebuild with -fprofile-use and -flto; the result is
+#      build/pgo-<variant>/libalarm_engine.a and alarm_loadgen.
+#   4. Build the plain configuration (no optimization flags, as
+#      "make all"), run both on the same mixes and report the
+#      best-of-REPEAT throughput of each and the speedup.
+#
+# Environment:
+#       QUEUE LOCK CLOCK SINK   The variant (default heap sem monotonic stdout)
+#       MIXES                   Training and comparison mixes
+#       TRAIN                   Seconds per training run (default 2)
+#       DURATION                Seconds per comparison run (default 1)
+#       REPEAT                  Comparison runs per mix (default 3)
+
+QUEUE=${QUEUE:-heap}
+LOCK=${LOCK:-sem}
+CLOCK=${CLOCK:-monotonic}
+SINK=${SINK:-stdout}
+MIXES=${MIXES:-"insert cancel fire"}
+TRAIN=${TRAIN:-2}
+DURATION=${DURATION:-1}
+REPEAT=${REPEAT:-3}
+
+VARIANT=$QUEUE-$LOCK-$CLOCK-$SINK
+CONFIG="QUEUE=$QUEUE LOCK=$LOCK CLOCK=$CLOCK SINK=$SINK"
+PLAIN=build/plain-$VARIANT
+PGO=build/pgo-$VARIANT
+
+# Throughput (ops/s) of the best of $REPEAT runs of $1 on mix $2.
+best () {
+    i=0
+    while [ $i -lt $REPEAT ]; do
+        $1 -m $2 -d $DURATION 2>&1 >/dev/null | cut -d' ' -f5
+        i=$((i + 1))
+    done | sort -n | tail -1
+}
+
+rm -rf $PGO
+echo "Building instrumented $PGO" >&2
+make -s loadgen $CONFIG BUILD=$PGO \
+    OPT="-O2 -fprofile-generate -fprofile-update=atomic" >&2 || exit 1
+
+for mix in $MIXES; do
+    echo "Training on the $mix mix" >&2
+    $PGO/alarm_loadgen -m $mix -d $TRAIN >/dev/null 2>&1 || exit 1
+done
+
+echo "Building optimized $PGO" >&2
+rm -f $PGO/*.o $PGO/*.a $PGO/alarm_loadgen
+make -s loadgen $CONFIG BUILD=$PGO AR=gcc-ar \
+    OPT="-O2 -flto -fprofile-use -fprofile-correction" >&2 || exit 1
+
+echo "Building plain $PLAIN" >&2
+make -s loadgen $CONFIG BUILD=$PLAIN OPT= >&2 || exit 1
+
+echo "mix plain-ops/s pgo-ops/s speedup"
+for mix in $MIXES; do
+    plain=$(best $PLAIN/alarm_loadgen $mix)
+    pgo=$(best $PGO/alarm_loadgen $mix)
+    echo "$mix $plain $pgo" | awk '{ printf "%s %s %s %.2f\n", $1, $2, $3, $3 / $2 }'
+done
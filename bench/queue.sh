@@ -0,0 +1,29 @@
+#!/bin/sh
+#
+# queue.sh
+#
+# Build the deadline queue benchmark for each queue and run it,
+# printing one line per queue (see bench_queue.c for the columns).
+# Run from the top of the tree, usually as "make bench-queue".
+#
+# Environment:
+#       QUEUES      Queues to cover (default list heap wheel radix hybrid)
+#       SIZE        Alarms in the queue (default 1000000)
+#       DURATION    Time limit per queue in seconds (default 10)
+#       SPREAD      If set, spread periods from 0.1 to SPREAD seconds
+#                   (bench_queue -p) instead of up to one second
+#       OPT         Optimization flags (default -O2)
+
+QUEUES=${QUEUES:-"list heap wheel radix hybrid"}
+SIZE=${SIZE:-1000000}
+DURATION=${DURATION:-10}
+SPREAD=${SPREAD:+"-p $SPREAD"}
+OPT=${OPT:-"-O2"}
+
+echo "queue size ops seconds ns/op"
+for queue in $QUEUES; do
+  make -s QUEUE=$queue OPT="$OPT" build/$queue-sem-monotonic-stdout/bench_queue \
+      >&2 || exit 1
+  build/$queue-sem-monotonic-stdout/bench_queue -n $SIZE -d $DURATION $SPREAD 2>&1 \
+      || exit 1
+done
@@ -0,0 +1,24 @@
+#
+# scaling.gp
+#
+# Plot one variant's bench_scaling results, as written by
+# scaling.sh: throughput and p99 operation latency against the
+# number of producers, one curve per worker count. Expects data,
+# variant and workers to be set with -e; writes a PNG to stdout.
+#
+set terminal png size 1200,500
+set multiplot layout 1,2 title variant
+set logscale x 2
+set xlabel "producers"
+set key top left
+
+set ylabel "ops/s"
+plot for [i=1:words(workers)] data index (i - 1) using 2:6 \
+    with linespoints title word(workers, i)." workers"
+
+set logscale y
+set ylabel "p99 schedule/cancel latency (ns)"
+plot for [i=1:words(workers)] data index (i - 1) using 2:8 \
+    with linespoints title word(workers, i)." workers"
+
+unset multiplot
@@ -0,0 +1,48 @@
+#!/bin/sh
+#
+# scaling.sh
+#
+# Build the scaling benchmark for each engine lock and run it for
+# every combination of producer and worker counts, printing one
+# line per run (see bench_scaling.c for the columns). The lines for
+# each lock also go to build/scaling-<variant>.dat, one block per
+# worker count, and if gnuplot is installed bench/scaling.gp plots
+# them to build/scaling-<variant>.png. Run from the top of the tree,
+# usually as "make bench-scaling".
+#
+# Environment:
+#       QUEUE CLOCK SINK            Other components (default heap,
+#                                   monotonic, null)
+#       LOCKS                       Locks to cover (default all)
+#       PRODUCERS WORKERS           Thread counts (default 1 2 4 ... 64)
+#       DURATION                    Seconds per run (default 0.5)
+#       OPT                         Optimization flags (default -O2)
+
+QUEUE=${QUEUE:-heap}
+CLOCK=${CLOCK:-monotonic}
+SINK=${SINK:-null}
+LOCKS=${LOCKS:-"sem rwlock brlock"}
+PRODUCERS=${PRODUCERS:-"1 2 4 8 16 32 64"}
+WORKERS=${WORKERS:-"1 2 4 8 16 32 64"}
+DURATION=${DURATION:-0.5}
+OPT=${OPT:-"-O2"}
+
+echo "variant producers workers seconds ops ops/s fires op_p99_ns fire_p99_ns"
+for lock in $LOCKS; do
+  variant=$QUEUE-$lock-$CLOCK-$SINK
+  make -s build/$variant/bench_scaling QUEUE=$QUEUE LOCK=$lock \
+      CLOCK=$CLOCK SINK=$SINK OPT="$OPT" >&2 || exit 1
+  data=build/scaling-$variant.dat
+  : > $data
+  for workers in $WORKERS; do
+    for producers in $PRODUCERS; do
+      build/$variant/bench_scaling -p $producers -w $workers \
+          -d $DURATION 2>&1 >/dev/null | tee -a $data || exit 1
+    done
+    printf '\n\n' >> $data
+  done
+  if command -v gnuplot >/dev/null 2>&1; then
+    gnuplot -e "data='$data'; variant='$variant'; workers='$WORKERS'" \
+        bench/scaling.gp > build/scaling-$variant.png
+  fi
+done
@@ -0,0 +1,301 @@
+/*
+ * soak.c
+ *
+ * Soak test for New_Alarm_Cond. It runs the program with its
+ * standard input and output on pipes, and feeds it a steady churn of
+ * new alarms, replacements and cancels, keeping about the same number
+ * of alarms alive throughout. Every interval it samples the program's
+ * resident set size and thread count from /proc (so this only runs on
+ * Linux), asks the program how many alarms it holds, and prints a
+ * line:
+ *
+ *      seconds ops rss_kb live threads
+ *
+ * live is the program's own count: the number of alarms listed by a
+ * "Next:" command asking for all of them, which includes cancelled
+ * alarms not yet removed. A reader thread drains the program's output
+ * and counts the lines of each listing, which ends where the program
+ * answers a cancel of alarm 0, a number no alarm has. Each sample
+ * sends a query and shows the latest answer, usually to the query
+ * before it (-1 until the first answer).
+ *
+ * At the end it fits a line to RSS against operations over the second
+ * half of the run (the first is left for the heap to warm up, while
+ * cancelled alarms wait out their periods), and reports the slope in
+ * bytes per operation and the growth the fit gives over those
+ * operations. RSS moves a few pages with no leak at all, and more
+ * when a display thread starts late in the run, so the run fails,
+ * with status 1, only if that growth is above a tolerance.
+ *
+ * Usage: soak [-d seconds] [-i interval] [-r ops/s] [-l live]
+ *             [-s seed] [-t kb] program
+ *
+ *      -d seconds      Run time (default 60)
+ *      -i interval     Seconds between samples (default 1)
+ *      -r rate         Commands per second (default 1000)
+ *      -l live         Alarms kept alive (default 100)
+ *      -s seed         Random seed (default 1)
+ *      -t kb           Growth allowed, in KB (default 128, 32 pages)
+ */
+#include <sys/types.h>
+#include <sys/wait.h>
+#include <signal.h>
+#include <limits.h>
+#include <pthread.h>
+#include <string.h>
+#include <time.h>
+#include "errors.h"
+
+#define QUERY_END       "Error: No Alarm Request With Message Number (0) "
+
+typedef struct sample_tag {
+    double              seconds;
+    long                ops;
+    long                rss_kb;
+} sample_t;
+
+/*
+ * The latest answer to a live query, filled in by the reader thread,
+ * or -1 before the first answer.
+ */
+static pthread_mutex_t query_mutex = PTHREAD_MUTEX_INITIALIZER;
+static long query_live = -1;
+
+/*
+ * Reads the program's output until it exits, counting the alarms
+ * each "Next:" listing names, and publishes the count when the
+ * marker that follows the listing arrives. Everything else the
+ * program prints is thrown away.
+ */
+static void *reader_routine (void *arg)
+{
+    FILE *output = (FILE*)arg;
+    char line[512];
+    long listed = 0;
+    int status;
+
+    while (fgets (line, sizeof (line), output) != NULL) {
+        if (strstr (line, ") Due at <") != NULL)
+            listed++;
+        else if (strncmp (line, QUERY_END, sizeof (QUERY_END) - 1) == 0) {
+            status = pthread_mutex_lock (&query_mutex);
+            if (status != 0)
+                err_abort (status, "Lock query");
+            query_live = listed;
+            status = pthread_mutex_unlock (&query_mutex);
+            if (status != 0)
+                err_abort (status, "Unlock query");
+            listed = 0;
+        }
+    }
+    fclose (output);
+    return NULL;
+}
+
+/*
+ * Asks the program for every alarm it holds, then for the marker,
+ * and returns the answer to the last query. The program's output is
+ * a pipe, and so not line buffered; the answer comes when its buffer
+ * fills, which under the churn takes a few dozen commands, and not
+ * waiting for it keeps the commands to their rate.
+ */
+static long query_send (FILE *command)
+{
+    long live;
+    int status;
+
+    fprintf (command, "Next: %d\nCancel: Message(0)\n", INT_MAX);
+    fflush (command);
+    status = pthread_mutex_lock (&query_mutex);
+    if (status != 0)
+        err_abort (status, "Lock query");
+    live = query_live;
+    status = pthread_mutex_unlock (&query_mutex);
+    if (status != 0)
+        err_abort (status, "Unlock query");
+    return live;
+}
+
+/*
+ * Reads the VmRSS and Threads fields of /proc/<pid>/status.
+ */
+static void read_status (pid_t pid, long *rss_kb, long *threads)
+{
+    char path[64], line[256];
+    FILE *status;
+
+    *rss_kb = *threads = -1;
+    snprintf (path, sizeof (path), "/proc/%d/status", (int)pid);
+    status = fopen (path, "r");
+    if (status == NULL)
+        errno_abort ("Open process status");
+    while (fgets (line, sizeof (line), status) != NULL) {
+        sscanf (line, "VmRSS: %ld", rss_kb);
+        sscanf (line, "Threads: %ld", threads);
+    }
+    fclose (status);
+}
+
+static double now_seconds (void)
+{
+    struct timespec now;
+
+    clock_gettime (CLOCK_MONOTONIC, &now);
+    return now.tv_sec + now.tv_nsec / 1e9;
+}
+
+int main (int argc, char *argv[])
+{
+    double seconds = 60.0, interval = 1.0, rate = 1000.0;
+    double start, next_sample, elapsed, delay;
+    double tolerance = 128.0, mean_ops, mean_rss, covariance, variance;
+    double slope, growth;
+    sample_t *samples;
+    int sample_count = 0, max_samples, first;
+    int *live, live_target = 100, live_count = 0, next_id = 1;
+    unsigned seed = 1;
+    long ops = 0, rss_kb, threads, program_live;
+    int option, pipe_fd[2], output_fd[2], victim, status, i;
+    FILE *command, *output;
+    pthread_t reader;
+    pid_t pid;
+
+    while ((option = getopt (argc, argv, "d:i:r:l:s:t:")) != -1) {
+        switch (option) {
+        case 'd': seconds = atof (optarg); break;
+        case 'i': interval = atof (optarg); break;
+        case 'r': rate = atof (optarg); break;
+        case 'l': live_target = atoi (optarg); break;
+        case 's': seed = atoi (optarg); break;
+        case 't': tolerance = atof (optarg); break;
+        default:
+            fprintf (stderr, "usage: %s [-d seconds] [-i interval]"
+                " [-r ops/s] [-l live] [-s seed] [-t kb] program\n",
+                argv[0]);
+            exit (1);
+        }
+    }
+    if (optind != argc - 1 || live_target < 1 || rate <= 0
+            || tolerance < 0) {
+        fprintf (stderr, "usage: %s [-d seconds] [-i interval]"
+            " [-r ops/s] [-l live] [-s seed] [-t kb] program\n", argv[0]);
+        exit (1);
+    }
+
+    max_samples = (int)(seconds / interval) + 2;
+    samples = (sample_t*)malloc (max_samples * sizeof (sample_t));
+    live = (int*)malloc (live_target * sizeof (int));
+    if (samples == NULL || live == NULL)
+        errno_abort ("Allocate soak");
+
+    if (pipe (pipe_fd) == -1 || pipe (output_fd) == -1)
+        errno_abort ("Create pipe");
+    pid = fork ();
+    if (pid == -1)
+        errno_abort ("Fork");
+    if (pid == 0) {
+        dup2 (pipe_fd[0], 0);
+        dup2 (output_fd[1], 1);
+        close (pipe_fd[0]);
+        close (pipe_fd[1]);
+        close (output_fd[0]);
+        close (output_fd[1]);
+        execl (argv[optind], argv[optind], (char*)NULL);
+        errno_abort ("Run program");
+    }
+    close (pipe_fd[0]);
+    close (output_fd[1]);
+    command = fdopen (pipe_fd[1], "w");
+    output = fdopen (output_fd[0], "r");
+    if (command == NULL || output == NULL)
+        errno_abort ("Open program pipes");
+    status = pthread_create (&reader, NULL, reader_routine, output);
+    if (status != 0)
+        err_abort (status, "Create reader");
+
+    printf ("seconds ops rss_kb live threads\n");
+    start = now_seconds ();
+    next_sample = start;
+    while ((elapsed = now_seconds () - start) < seconds) {
+        if (now_seconds () >= next_sample) {
+            read_status (pid, &rss_kb, &threads);
+            program_live = query_send (command);
+            printf ("%.1f %ld %ld %ld %ld\n",
+                elapsed, ops, rss_kb, program_live, threads);
+            fflush (stdout);
+            if (sample_count < max_samples) {
+                samples[sample_count].seconds = elapsed;
+                samples[sample_count].ops = ops;
+                samples[sample_count].rss_kb = rss_kb;
+                sample_count++;
+            }
+            next_sample += interval;
+        }
+
+        /*
+         * Top the live set up with new alarms, 1-3 seconds long;
+         * once it is full, replace and cancel in equal numbers.
+         * Message numbers are never reused, so a cancelled alarm
+         * still waiting to be processed is never mistaken for a
+         * live one.
+         */
+        if (live_count < live_target) {
+            live[live_count++] = next_id;
+            fprintf (command, "%d Message(%d) Soak%d\n",
+                1 + rand_r (&seed) % 3, next_id, next_id);
+            next_id++;
+        } else {
+            victim = rand_r (&seed) % live_count;
+            if (rand_r (&seed) % 2)
+                fprintf (command, "%d Message(%d) Replaced%ld\n",
+                    1 + rand_r (&seed) % 3, live[victim], ops);
+            else {
+                fprintf (command, "Cancel: Message(%d)\n", live[victim]);
+                live[victim] = live[--live_count];
+            }
+        }
+        fflush (command);
+        ops++;
+
+        /* Pace the commands to the requested rate. */
+        delay = ops / rate - (now_seconds () - start);
+        if (delay > 0)
+            usleep ((useconds_t)(delay * 1000000));
+    }
+    fclose (command);
+    kill (pid, SIGTERM);
+    waitpid (pid, NULL, 0);
+    status = pthread_join (reader, NULL);
+    if (status != 0)
+        err_abort (status, "Join reader");
+
+    if (sample_count < 8) {
+        fprintf (stderr, "Too few samples to judge growth\n");
+        exit (1);
+    }
+
+    /* Least squares fit of RSS to operations, after the warm-up. */
+    first = sample_count / 2;
+    mean_ops = mean_rss = 0.0;
+    for (i = first; i < sample_count; i++) {
+        mean_ops += samples[i].ops;
+        mean_rss += samples[i].rss_kb;
+    }
+    mean_ops /= sample_count - first;
+    mean_rss /= sample_count - first;
+    covariance = variance = 0.0;
+    for (i = first; i < sample_count; i++) {
+        covariance += (samples[i].ops - mean_ops)
+            * (samples[i].rss_kb - mean_rss);
+        variance += (samples[i].ops - mean_ops)
+            * (samples[i].ops - mean_ops);
+    }
+    slope = variance > 0.0 ? covariance / variance : 0.0;
+    growth = slope * (samples[sample_count - 1].ops - samples[first].ops);
+    printf ("growth %.3f bytes/op, %.0f KB over %ld ops"
+        " (tolerance %.0f KB)\n", slope * 1024.0, growth,
+        samples[sample_count - 1].ops - samples[first].ops, tolerance);
+    free (samples);
+    free (live);
+    return growth > tolerance ? 1 : 0;
+}
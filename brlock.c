@@ -0,0 +1,126 @@
+/*
+ * brlock.c
+ *
+ * The big-reader lock; see brlock.h.
+ *
+ * A reader increments its slot and then checks the writer flag; a
+ * writer sets the flag and then checks every slot. Both use
+ * sequentially consistent operations, so at least one of them sees
+ * the other: either the reader backs out, or the writer waits for it.
+ */
+#ifdef __linux__
+# define _GNU_SOURCE    /* For sched_getcpu */
+#endif
+#include <pthread.h>
+#include <sched.h>
+#include "errors.h"
+#include "brlock.h"
+
+/*
+ * The slot for the calling thread: its processor's, where that can
+ * be found cheaply, or else one fixed per thread.
+ */
+static int brlock_slot (void)
+{
+#ifdef __linux__
+    int cpu = sched_getcpu ();
+
+    if (cpu >= 0)
+        return cpu & (BRLOCK_SLOTS - 1);
+#endif
+    static atomic_int next_slot;
+    static __thread int slot = -1;
+
+    if (slot < 0)
+        slot = atomic_fetch_add (&next_slot, 1) & (BRLOCK_SLOTS - 1);
+    return slot;
+}
+
+void brlock_init (brlock_t *lock)
+{
+    int i;
+
+    for (i = 0; i < BRLOCK_SLOTS; i++)
+        atomic_init (&lock->slots[i].readers, 0);
+    atomic_init (&lock->writer, 0);
+    pthread_mutex_init (&lock->write_mutex, NULL);
+    pthread_mutex_init (&lock->wait_mutex, NULL);
+    pthread_cond_init (&lock->wait_cond, NULL);
+}
+
+void brlock_destroy (brlock_t *lock)
+{
+    pthread_mutex_destroy (&lock->write_mutex);
+    pthread_mutex_destroy (&lock->wait_mutex);
+    pthread_cond_destroy (&lock->wait_cond);
+}
+
+int brlock_read_lock (brlock_t *lock)
+{
+    int slot = brlock_slot (), status;
+
+    while (1) {
+        atomic_fetch_add (&lock->slots[slot].readers, 1);
+        if (!atomic_load (&lock->writer))
+            return slot;
+
+        /*
+         * A writer wants in: back out, and wait until it is done.
+         */
+        atomic_fetch_sub (&lock->slots[slot].readers, 1);
+        status = pthread_mutex_lock (&lock->wait_mutex);
+        if (status != 0)
+            err_abort (status, "Lock brlock wait");
+        while (atomic_load (&lock->writer)) {
+            status = pthread_cond_wait (&lock->wait_cond, &lock->wait_mutex);
+            if (status != 0)
+                err_abort (status, "Wait for brlock writer");
+        }
+        status = pthread_mutex_unlock (&lock->wait_mutex);
+        if (status != 0)
+            err_abort (status, "Unlock brlock wait");
+    }
+}
+
+void brlock_read_unlock (brlock_t *lock, int slot)
+{
+    atomic_fetch_sub_explicit (
+        &lock->slots[slot].readers, 1, memory_order_release);
+}
+
+void brlock_write_lock (brlock_t *lock)
+{
+    int i, status;
+
+    status = pthread_mutex_lock (&lock->write_mutex);
+    if (status != 0)
+        err_abort (status, "Lock brlock writer");
+    atomic_store (&lock->writer, 1);
+
+    /*
+     * Read holds are short, so spin (politely) for the readers
+     * already inside to leave.
+     */
+    for (i = 0; i < BRLOCK_SLOTS; i++)
+        while (atomic_load (&lock->slots[i].readers) != 0)
+            sched_yield ();
+}
+
+void brlock_write_unlock (brlock_t *lock)
+{
+    int status;
+
+    status = pthread_mutex_lock (&lock->wait_mutex);
+    if (status != 0)
+        err_abort (status, "Lock brlock wait");
+    atomic_store (&lock->writer, 0);
+    status = pthread_cond_broadcast (&lock->wait_cond);
+    if (status != 0)
+        err_abort (status, "Broadcast brlock readers");
+    status = pthread_mutex_unlock (&lock->wait_mutex);
+    if (status != 0)
+        err_abort (status, "Unlock brlock wait");
+    status = pthread_mutex_unlock (&lock->write_mutex);
+    if (status != 0)
+        err_abort (status, "Unlock brlock writer");
+}
@@ -0,0 +1,52 @@
+#ifndef __brlock_h
+#define __brlock_h
+
+#include <pthread.h>
+#include <stdatomic.h>
+
+/*
+ * A "big-reader" lock: a readers/writer lock whose readers scale
+ * across processors and whose writers never starve.
+ *
+ * A reader counts itself in the slot of the processor it is running
+ * on, and every slot has a cache line to itself, so readers on
+ * different processors never write the same line. A writer raises
+ * the writer flag, which turns new readers away, and then waits for
+ * every slot to drain; readers turned away block until the writer
+ * is done. So once a writer has asked for the lock, it gets it as
+ * soon as the readers already inside leave, however many more keep
+ * arriving. The price is that a writer has to look at every slot.
+ *
+ * A reader gets a slot number from brlock_read_lock and hands it
+ * back to brlock_read_unlock, since it may have moved to another
+ * processor in between:
+ *
+ *      slot = brlock_read_lock (&lock);
+ *      ... read ...
+ *      brlock_read_unlock (&lock, slot);
+ *
+ * Neither kind of hold is recursive.
+ */
+#define BRLOCK_SLOTS    64      /* A power of two */
+#define BRLOCK_LINE     64      /* Bytes in a cache line */
+
+typedef struct brlock_slot_tag {
+    _Alignas (BRLOCK_LINE) atomic_int readers;
+} brlock_slot_t;
+
+typedef struct brlock_tag {
+    brlock_slot_t       slots[BRLOCK_SLOTS];
+    _Alignas (BRLOCK_LINE) atomic_int writer; /* A writer wants in */
+    pthread_mutex_t     write_mutex; /* Serializes writers */
+    pthread_mutex_t     wait_mutex; /* Readers waiting out a writer */
+    pthread_cond_t      wait_cond;
+} brlock_t;
+
+extern void brlock_init (brlock_t *lock);
+extern void brlock_destroy (brlock_t *lock);
+extern int brlock_read_lock (brlock_t *lock);
+extern void brlock_read_unlock (brlock_t *lock, int slot);
+extern void brlock_write_lock (brlock_t *lock);
+extern void brlock_write_unlock (brlock_t *lock);
+
+#endif
@@ -0,0 +1,330 @@
+/*
+ * btree.c
+ *
+ * The B+-tree; see btree.h. Inserts split a full node into two
+ * halves on the way back up from the leaf; removes refill a node
+ * that has fallen below BTREE_MIN keys from a sibling, or merge it
+ * with one, on the way back up. The keys in interior nodes only
+ * separate subtrees, and are not removed with the values they were
+ * copied from.
+ */
+#include <limits.h>
+#include "errors.h"
+#include "btree.h"
+
+static btree_node_t *node_new (int leaf)
+{
+    btree_node_t *node;
+
+    if (posix_memalign ((void**)&node, BTREE_LINE, sizeof (btree_node_t)) != 0)
+        return NULL;
+    node->count = 0;
+    node->leaf = leaf;
+    node->next = NULL;
+    return node;
+}
+
+/* The first of count keys that is above key, or count. */
+static int upper_bound (const int *keys, int count, int key)
+{
+    int i;
+
+    for (i = 0; i < count && keys[i] <= key; i++)
+        ;
+    return i;
+}
+
+/* The first of count keys that is at or above key, or count. */
+static int lower_bound (const int *keys, int count, int key)
+{
+    int i;
+
+    for (i = 0; i < count && keys[i] < key; i++)
+        ;
+    return i;
+}
+
+int btree_init (btree_t *tree)
+{
+    tree->root = node_new (1);
+    return tree->root == NULL ? ENOMEM : 0;
+}
+
+/*
+ * Insert into the subtree under node. If node had to be split, the
+ * new right half is returned in *split and the key separating it in
+ * *split_key.
+ */
+static int node_insert (btree_node_t *node, int key, void *value,
+    btree_node_t **split, int *split_key)
+{
+    btree_node_t *right, *child = NULL;
+    int keys[BTREE_ORDER + 1];
+    btree_node_t *children[BTREE_ORDER + 2];
+    int pos, half, status, child_key;
+
+    *split = NULL;
+    if (node->leaf) {
+        pos = lower_bound (node->keys, node->count, key);
+        if (pos < node->count && node->keys[pos] == key)
+            return EEXIST;
+        if (node->count == BTREE_ORDER) {
+            right = node_new (1);
+            if (right == NULL)
+                return ENOMEM;
+            half = BTREE_ORDER / 2;
+            right->count = BTREE_ORDER - half;
+            memcpy (right->keys, node->keys + half, right->count * sizeof (int));
+            memcpy (right->u.values, node->u.values + half,
+                right->count * sizeof (void*));
+            node->count = half;
+            right->next = node->next;
+            node->next = right;
+            *split = right;
+            if (pos > half) {
+                node = right;
+                pos -= half;
+            }
+        }
+        memmove (node->keys + pos + 1, node->keys + pos,
+            (node->count - pos) * sizeof (int));
+        memmove (node->u.values + pos + 1, node->u.values + pos,
+            (node->count - pos) * sizeof (void*));
+        node->keys[pos] = key;
+        node->u.values[pos] = value;
+        node->count++;
+        if (*split != NULL)
+            *split_key = (*split)->keys[0];
+        return 0;
+    }
+
+    pos = upper_bound (node->keys, node->count, key);
+    status = node_insert (node->u.children[pos], key, value, &child, &child_key);
+    if (status != 0 || child == NULL)
+        return status;
+
+    if (node->count < BTREE_ORDER) {
+        memmove (node->keys + pos + 1, node->keys + pos,
+            (node->count - pos) * sizeof (int));
+        memmove (node->u.children + pos + 2, node->u.children + pos + 1,
+            (node->count - pos) * sizeof (btree_node_t*));
+        node->keys[pos] = child_key;
+        node->u.children[pos + 1] = child;
+        node->count++;
+        return 0;
+    }
+
+    /*
+     * Split a full interior node: lay out its keys and children with
+     * the new ones in place, keep the lower half, move the upper
+     * half to a new node, and pass the middle key up.
+     */
+    right = node_new (0);
+    if (right == NULL)
+        return ENOMEM;
+    memcpy (keys, node->keys, pos * sizeof (int));
+    keys[pos] = child_key;
+    memcpy (keys + pos + 1, node->keys + pos,
+        (BTREE_ORDER - pos) * sizeof (int));
+    memcpy (children, node->u.children, (pos + 1) * sizeof (btree_node_t*));
+    children[pos + 1] = child;
+    memcpy (children + pos + 2, node->u.children + pos + 1,
+        (BTREE_ORDER - pos) * sizeof (btree_node_t*));
+
+    half = (BTREE_ORDER + 1) / 2;
+    node->count = half;
+    memcpy (node->keys, keys, half * sizeof (int));
+    memcpy (node->u.children, children, (half + 1) * sizeof (btree_node_t*));
+    right->count = BTREE_ORDER - half;
+    memcpy (right->keys, keys + half + 1, right->count * sizeof (int));
+    memcpy (right->u.children, children + half + 1,
+        (right->count + 1) * sizeof (btree_node_t*));
+    *split = right;
+    *split_key = keys[half];
+    return 0;
+}
+
+/*
+ * Returns 0, EEXIST if key is already present, or ENOMEM.
+ */
+int btree_insert (btree_t *tree, int key, void *value)
+{
+    btree_node_t *split, *root;
+    int split_key, status;
+
+    status = node_insert (tree->root, key, value, &split, &split_key);
+    if (status != 0 || split == NULL)
+        return status;
+
+    root = node_new (0);
+    if (root == NULL)
+        return ENOMEM;
+    root->count = 1;
+    root->keys[0] = split_key;
+    root->u.children[0] = tree->root;
+    root->u.children[1] = split;
+    tree->root = root;
+    return 0;
+}
+
+void *btree_find (btree_t *tree, int key)
+{
+    btree_node_t *node = tree->root;
+    int pos;
+
+    while (!node->leaf)
+        node = node->u.children[upper_bound (node->keys, node->count, key)];
+    pos = lower_bound (node->keys, node->count, key);
+    if (pos < node->count && node->keys[pos] == key)
+        return node->u.values[pos];
+    return NULL;
+}
+
+/*
+ * Merge parent's child pos + 1 into child pos, and drop the key
+ * between them from parent.
+ */
+static void node_merge (btree_node_t *parent, int pos)
+{
+    btree_node_t *left = parent->u.children[pos];
+    btree_node_t *right = parent->u.children[pos + 1];
+
+    if (left->leaf) {
+        memcpy (left->keys + left->count, right->keys,
+            right->count * sizeof (int));
+        memcpy (left->u.values + left->count, right->u.values,
+            right->count * sizeof (void*));
+        left->count += right->count;
+        left->next = right->next;
+    } else {
+        left->keys[left->count] = parent->keys[pos];
+        memcpy (left->keys + left->count + 1, right->keys,
+            right->count * sizeof (int));
+        memcpy (left->u.children + left->count + 1, right->u.children,
+            (right->count + 1) * sizeof (btree_node_t*));
+        left->count += 1 + right->count;
+    }
+    free (right);
+
+    memmove (parent->keys + pos, parent->keys + pos + 1,
+        (parent->count - pos - 1) * sizeof (int));
+    memmove (parent->u.children + pos + 1, parent->u.children + pos + 2,
+        (parent->count - pos - 1) * sizeof (btree_node_t*));
+    parent->count--;
+}
+
+/*
+ * Child pos of parent has fallen below BTREE_MIN keys: move one over
+ * from a sibling that can spare it, or else merge with a sibling.
+ */
+static void node_refill (btree_node_t *parent, int pos)
+{
+    btree_node_t *child = parent->u.children[pos], *sibling;
+
+    if (pos > 0 && parent->u.children[pos - 1]->count > BTREE_MIN) {
+        sibling = parent->u.children[pos - 1];
+        memmove (child->keys + 1, child->keys, child->count * sizeof (int));
+        if (child->leaf) {
+            memmove (child->u.values + 1, child->u.values,
+                child->count * sizeof (void*));
+            child->keys[0] = sibling->keys[sibling->count - 1];
+            child->u.values[0] = sibling->u.values[sibling->count - 1];
+            parent->keys[pos - 1] = child->keys[0];
+        } else {
+            memmove (child->u.children + 1, child->u.children,
+                (child->count + 1) * sizeof (btree_node_t*));
+            child->keys[0] = parent->keys[pos - 1];
+            child->u.children[0] = sibling->u.children[sibling->count];
+            parent->keys[pos - 1] = sibling->keys[sibling->count - 1];
+        }
+        sibling->count--;
+        child->count++;
+    } else if (pos < parent->count
+            && parent->u.children[pos + 1]->count > BTREE_MIN) {
+        sibling = parent->u.children[pos + 1];
+        if (child->leaf) {
+            child->keys[child->count] = sibling->keys[0];
+            child->u.values[child->count] = sibling->u.values[0];
+            memmove (sibling->u.values, sibling->u.values + 1,
+                (sibling->count - 1) * sizeof (void*));
+            memmove (sibling->keys, sibling->keys + 1,
+                (sibling->count - 1) * sizeof (int));
+            parent->keys[pos] = sibling->keys[0];
+        } else {
+            child->keys[child->count] = parent->keys[pos];
+            child->u.children[child->count + 1] = sibling->u.children[0];
+            parent->keys[pos] = sibling->keys[0];
+            memmove (sibling->keys, sibling->keys + 1,
+                (sibling->count - 1) * sizeof (int));
+            memmove (sibling->u.children, sibling->u.children + 1,
+                sibling->count * sizeof (btree_node_t*));
+        }
+        sibling->count--;
+        child->count++;
+    } else if (pos > 0)
+        node_merge (parent, pos - 1);
+    else
+        node_merge (parent, pos);
+}
+
+static void *node_remove (btree_node_t *node, int key)
+{
+    void *value;
+    int pos;
+
+    if (node->leaf) {
+        pos = lower_bound (node->keys, node->count, key);
+        if (pos == node->count || node->keys[pos] != key)
+            return NULL;
+        value = node->u.values[pos];
+        memmove (node->keys + pos, node->keys + pos + 1,
+            (node->count - pos - 1) * sizeof (int));
+        memmove (node->u.values + pos, node->u.values + pos + 1,
+            (node->count - pos - 1) * sizeof (void*));
+        node->count--;
+        return value;
+    }
+
+    pos = upper_bound (node->keys, node->count, key);
+    value = node_remove (node->u.children[pos], key);
+    if (value != NULL && node->u.children[pos]->count < BTREE_MIN)
+        node_refill (node, pos);
+    return value;
+}
+
+/*
+ * Removes key, and returns the value it had, or NULL if it was not
+ * present.
+ */
+void *btree_remove (btree_t *tree, int key)
+{
+    btree_node_t *root = tree->root;
+    void *value;
+
+    value = node_remove (root, key);
+    if (!root->leaf && root->count == 0) {
+        tree->root = root->u.children[0];
+        free (root);
+    }
+    return value;
+}
+
+/*
+ * Stores the values of up to max keys above after in values, in key
+ * order, and returns how many were stored.
+ */
+int btree_scan (btree_t *tree, int after, void **values, int max)
+{
+    btree_node_t *node = tree->root;
+    int count = 0, pos;
+
+    if (after == INT_MAX)
+        return 0;
+    while (!node->leaf)
+        node = node->u.children[upper_bound (node->keys, node->count, after)];
+    pos = upper_bound (node->keys, node->count, after);
+    for (; node != NULL && count < max; node = node->next, pos = 0)
+        for (; pos < node->count && count < max; pos++)
+            values[count++] = node->u.values[pos];
+    return count;
+}
@@ -0,0 +1,47 @@
+#ifndef __btree_h
+#define __btree_h
+
+/*
+ * An in-memory B+-tree mapping int keys to pointers, kept in key
+ * order. Every value is in a leaf, and the leaves are chained in key
+ * order, so an ordered scan reads leaf arrays one after another.
+ *
+ * A node's keys fill exactly one cache line, so choosing the branch
+ * to follow, or the slot in a leaf, touches one line of the node;
+ * with BTREE_ORDER keys a node, a million keys are five levels deep,
+ * and a lookup costs a handful of cache misses.
+ *
+ * None of these functions lock; the owner of the tree does.
+ */
+#define BTREE_LINE      64      /* Bytes in a cache line */
+#define BTREE_ORDER     (BTREE_LINE / (int)sizeof (int)) /* Keys a node */
+#define BTREE_MIN       (BTREE_ORDER / 2 - 1) /* Keys a node, bar the root */
+
+/*
+ * An interior node with count keys has count + 1 children, and
+ * every key under children[i] is below keys[i] and at or above
+ * keys[i - 1]. A leaf has count keys and values, and next is the
+ * leaf after it.
+ */
+typedef struct btree_node_tag {
+    _Alignas (BTREE_LINE) int keys[BTREE_ORDER];
+    int                 count;
+    int                 leaf;
+    union {
+        void            *values[BTREE_ORDER];
+        struct btree_node_tag *children[BTREE_ORDER + 1];
+    } u;
+    struct btree_node_tag *next;
+} btree_node_t;
+
+typedef struct btree_tag {
+    btree_node_t        *root;
+} btree_t;
+
+extern int btree_init (btree_t *tree);
+extern int btree_insert (btree_t *tree, int key, void *value);
+extern void *btree_find (btree_t *tree, int key);
+extern void *btree_remove (btree_t *tree, int key);
+extern int btree_scan (btree_t *tree, int after, void **values, int max);
+
+#endif
@@ -0,0 +1,192 @@
+/*
+ * deadline_heap.c
+ *
+ * Indexed binary min-heap of deadlines; see deadline_heap.h.
+ */
+#include "errors.h"
+#include "deadline_heap.h"
+
+static void place (deadline_heap_t *heap, int index, deadline_node_t *node)
+{
+    heap->nodes[index] = node;
+    node->index = index;
+}
+
+static void sift_up (deadline_heap_t *heap, int index)
+{
+    deadline_node_t *node = heap->nodes[index];
+    int parent;
+
+    while (index > 0) {
+        parent = (index - 1) / 2;
+        if (!deadline_before (node, heap->nodes[parent]))
+            break;
+        place (heap, index, heap->nodes[parent]);
+        index = parent;
+    }
+    place (heap, index, node);
+}
+
+static void sift_down (deadline_heap_t *heap, int index)
+{
+    deadline_node_t *node = heap->nodes[index];
+    int child;
+
+    while ((child = 2 * index + 1) < heap->count) {
+        if (child + 1 < heap->count
+            && deadline_before (heap->nodes[child + 1], heap->nodes[child]))
+            child++;
+        if (!deadline_before (heap->nodes[child], node))
+            break;
+        place (heap, index, heap->nodes[child]);
+        index = child;
+    }
+    place (heap, index, node);
+}
+
+/*
+ * Initialize an empty heap with room for size nodes. The heap grows
+ * past that on demand. Returns 0 or ENOMEM.
+ */
+int deadline_heap_init (deadline_heap_t *heap, int size)
+{
+    if (size < 1)
+        size = 1;
+    heap->nodes = (deadline_node_t**)calloc (size, sizeof (deadline_node_t*));
+    if (heap->nodes == NULL)
+        return ENOMEM;
+    heap->count = 0;
+    heap->size = size;
+    return 0;
+}
+
+void deadline_heap_destroy (deadline_heap_t *heap)
+{
+    free (heap->nodes);
+    heap->nodes = NULL;
+    heap->count = heap->size = 0;
+}
+
+/*
+ * Add a node that is not already queued. Returns 0, or ENOMEM if
+ * the heap was full and could not be grown.
+ */
+int deadline_heap_push (deadline_heap_t *heap, deadline_node_t *node)
+{
+    deadline_node_t **nodes;
+
+    if (heap->count == heap->size) {
+        nodes = (deadline_node_t**)realloc (
+            heap->nodes, 2 * heap->size * sizeof (deadline_node_t*));
+        if (nodes == NULL)
+            return ENOMEM;
+        heap->nodes = nodes;
+        heap->size *= 2;
+    }
+    heap->nodes[heap->count] = node;
+    sift_up (heap, heap->count++);
+    return 0;
+}
+
+/*
+ * Remove a queued node from wherever it is in the heap.
+ */
+void deadline_heap_remove (deadline_heap_t *heap, deadline_node_t *node)
+{
+    int index = node->index;
+    deadline_node_t *last;
+
+    node->index = -1;
+    last = heap->nodes[--heap->count];
+    if (last == node)
+        return;
+    place (heap, index, last);
+    deadline_heap_update (heap, last);
+}
+
+/*
+ * Restore the heap order after the deadline of a queued node has
+ * been changed, in either direction.
+ */
+void deadline_heap_update (deadline_heap_t *heap, deadline_node_t *node)
+{
+    int index = node->index;
+
+    if (index > 0 && deadline_before (node, heap->nodes[(index - 1) / 2]))
+        sift_up (heap, index);
+    else
+        sift_down (heap, index);
+}
+
+/*
+ * Remove and return the node with the earliest deadline, or NULL
+ * if the heap is empty.
+ */
+deadline_node_t *deadline_heap_pop (deadline_heap_t *heap)
+{
+    deadline_node_t *node = deadline_heap_peek (heap);
+
+    if (node != NULL)
+        deadline_heap_remove (heap, node);
+    return node;
+}
+
+/*
+ * Store the n earliest nodes in out, earliest first, and return how
+ * many were stored. The heap is not modified. This is a best-first
+ * walk of the heap: a small candidate heap of heap positions starts
+ * with the root, and every time the earliest candidate is taken its
+ * two children become candidates. That visits at most 2n + 1 nodes,
+ * for O(n log n) work whatever the size of the heap. Returns -1,
+ * with errno set, if the candidate heap cannot be allocated.
+ */
+int deadline_heap_smallest (
+    deadline_heap_t *heap, deadline_node_t **out, int n)
+{
+    int *candidates;
+    int count = 0, found = 0;
+    int index, child, i, c, j;
+
+    if (n > heap->count)
+        n = heap->count;
+    if (n <= 0)
+        return 0;
+    candidates = (int*)malloc ((n + 1) * sizeof (int));
+    if (candidates == NULL)
+        return -1;
+
+    candidates[count++] = 0;
+    while (found < n) {
+        index = candidates[0];
+        out[found++] = heap->nodes[index];
+
+        /*
+         * Replace the taken candidate with the last one and sift it
+         * down, then add the children of the taken node.
+         */
+        candidates[0] = candidates[--count];
+        for (i = 0; (c = 2 * i + 1) < count; i = c) {
+            if (c + 1 < count && deadline_before (
+                    heap->nodes[candidates[c + 1]], heap->nodes[candidates[c]]))
+                c++;
+            if (!deadline_before (heap->nodes[candidates[c]], heap->nodes[candidates[i]]))
+                break;
+            j = candidates[i];
+            candidates[i] = candidates[c];
+            candidates[c] = j;
+        }
+        for (child = 2 * index + 1; child <= 2 * index + 2; child++) {
+            if (child >= heap->count || count > n)
+                continue;
+            for (i = count++; i > 0; i = (i - 1) / 2) {
+                if (!deadline_before (heap->nodes[child],
+                        heap->nodes[candidates[(i - 1) / 2]]))
+                    break;
+                candidates[i] = candidates[(i - 1) / 2];
+            }
+            candidates[i] = child;
+        }
+    }
+    free (candidates);
+    return found;
+}
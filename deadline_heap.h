@@ -0,0 +1,63 @@
+#ifndef __deadline_heap_h
+#define __deadline_heap_h
+
+#include <stdint.h>
+
+/*
+ * An indexed binary min-heap of deadlines. The heap does not own
+ * its nodes: a deadline_node_t is embedded in whatever is being
+ * scheduled, and the heap keeps an array of pointers to them. Each
+ * node records its own position in that array, so a node can be
+ * removed or rescheduled in O(log n) without a search.
+ *
+ * Nodes are ordered by deadline, and by key among equal deadlines,
+ * so the order of a heap never depends on the order of insertion.
+ * The unit of the deadline is up to the owner.
+ *
+ * A node can equally be queued on one of the other deadline queues
+ * (see alarm_queue.h), which link it through next and prev instead
+ * of placing it in an array.
+ *
+ * None of these functions lock; the owner of the heap does.
+ */
+typedef struct deadline_node_tag {
+    int64_t             deadline;
+    int                 key;    /* Tie breaker, e.g. message number */
+    int                 index;  /* Slot in the heap, -1 if not queued */
+    struct deadline_node_tag *next, *prev; /* Used by linked queues */
+} deadline_node_t;
+
+/*
+ * The order every deadline queue keeps: by deadline, then by key.
+ */
+static inline int deadline_before (deadline_node_t *a, deadline_node_t *b)
+{
+    if (a->deadline != b->deadline)
+        return a->deadline < b->deadline;
+    return a->key < b->key;
+}
+
+typedef struct deadline_heap_tag {
+    deadline_node_t     **nodes;
+    int                 count;
+    int                 size;   /* Allocated slots */
+} deadline_heap_t;
+
+extern int deadline_heap_init (deadline_heap_t *heap, int size);
+extern void deadline_heap_destroy (deadline_heap_t *heap);
+extern int deadline_heap_push (deadline_heap_t *heap, deadline_node_t *node);
+extern void deadline_heap_remove (deadline_heap_t *heap, deadline_node_t *node);
+extern void deadline_heap_update (deadline_heap_t *heap, deadline_node_t *node);
+extern deadline_node_t *deadline_heap_pop (deadline_heap_t *heap);
+extern int deadline_heap_smallest (
+    deadline_heap_t *heap, deadline_node_t **out, int n);
+
+/*
+ * The node with the earliest deadline, or NULL if the heap is empty.
+ */
+static inline deadline_node_t *deadline_heap_peek (deadline_heap_t *heap)
+{
+    return heap->count > 0 ? heap->nodes[0] : NULL;
+}
+
+#endif
@@ -0,0 +1,184 @@
+/*
+ * epoch.c
+ *
+ * Epoch-based reclamation; see epoch.h.
+ *
+ * A global epoch counts up from 0. A thread entering a bracket
+ * publishes the epoch it saw in its record; a thread outside one
+ * publishes nothing. Retired objects wait in the limbo list of the
+ * epoch they were retired in, and the epoch only moves on from e to
+ * e + 1 once every thread inside a bracket has published e. So when
+ * it does, no thread can still be inside a bracket that began in
+ * e - 1 or earlier, when the objects retired in e - 2 might still
+ * have been found, and those can be reclaimed. Three limbo lists are
+ * enough: the one for e - 2 is emptied just as it becomes e + 1's.
+ *
+ * Records are never freed; a thread's record is marked free when the
+ * thread exits and handed to the next thread that needs one, so the
+ * list stays as long as the most threads ever running at once.
+ */
+#include <pthread.h>
+#include "errors.h"
+#include "epoch.h"
+
+#define EPOCH_LISTS     3
+#define EPOCH_BATCH     32      /* Retirements between attempts to advance */
+
+typedef struct epoch_record_tag {
+    struct epoch_record_tag *next;
+    atomic_ulong        state;  /* (epoch << 1) | 1 inside a bracket, or 0 */
+    atomic_int          in_use;
+} epoch_record_t;
+
+static atomic_ulong global_epoch;
+static _Atomic (epoch_record_t*) records;
+static _Atomic (epoch_retired_t*) limbo[EPOCH_LISTS];
+static atomic_uint retire_count;
+static pthread_mutex_t advance_mutex = PTHREAD_MUTEX_INITIALIZER;
+static pthread_once_t key_once = PTHREAD_ONCE_INIT;
+static pthread_key_t record_key;
+
+static __thread epoch_record_t *record;
+static __thread int depth;
+
+/*
+ * Thread-specific data destructor: give the exiting thread's record
+ * back.
+ */
+static void record_free (void *arg)
+{
+    epoch_record_t *free_record = (epoch_record_t*)arg;
+
+    atomic_store (&free_record->state, 0);
+    atomic_store (&free_record->in_use, 0);
+}
+
+static void key_create (void)
+{
+    int status;
+
+    status = pthread_key_create (&record_key, record_free);
+    if (status != 0)
+        err_abort (status, "Create epoch key");
+}
+
+/*
+ * Find the calling thread a record: a free one if there is one, or
+ * else a new one pushed on the front of the list.
+ */
+static epoch_record_t *record_get (void)
+{
+    epoch_record_t *next;
+    int unused, status;
+
+    if (record != NULL)
+        return record;
+    status = pthread_once (&key_once, key_create);
+    if (status != 0)
+        err_abort (status, "Once epoch key");
+
+    for (next = atomic_load (&records); next != NULL; next = next->next) {
+        unused = 0;
+        if (atomic_compare_exchange_strong (&next->in_use, &unused, 1))
+            break;
+    }
+    if (next == NULL) {
+        next = (epoch_record_t*)malloc (sizeof (epoch_record_t));
+        if (next == NULL)
+            errno_abort ("Allocate epoch record");
+        atomic_init (&next->state, 0);
+        atomic_init (&next->in_use, 1);
+        next->next = atomic_load (&records);
+        while (!atomic_compare_exchange_weak (&records, &next->next, next))
+            ;
+    }
+    status = pthread_setspecific (record_key, next);
+    if (status != 0)
+        err_abort (status, "Set epoch key");
+    record = next;
+    return record;
+}
+
+void epoch_enter (void)
+{
+    epoch_record_t *self;
+    unsigned long epoch;
+
+    if (depth++ > 0)
+        return;
+    self = record_get ();
+
+    /*
+     * Publish the epoch, and look again: if it has moved on, an
+     * advance may have missed this record, so publish the new one.
+     */
+    do {
+        epoch = atomic_load (&global_epoch);
+        atomic_store (&self->state, (epoch << 1) | 1);
+    } while (atomic_load (&global_epoch) != epoch);
+}
+
+void epoch_exit (void)
+{
+    if (--depth > 0)
+        return;
+    atomic_store (&record->state, 0);
+}
+
+/*
+ * Move the epoch on, if every thread inside a bracket has seen the
+ * current one, and reclaim what was retired two epochs ago. Gives up
+ * at once if another thread is already at it.
+ */
+static void epoch_advance (void)
+{
+    epoch_retired_t *retired, *next;
+    epoch_record_t *check;
+    unsigned long epoch, state;
+    int status;
+
+    if (pthread_mutex_trylock (&advance_mutex) != 0)
+        return;
+    epoch = atomic_load (&global_epoch);
+    for (check = atomic_load (&records); check != NULL; check = check->next) {
+        state = atomic_load (&check->state);
+        if ((state & 1) && (state >> 1) != epoch)
+            break;
+    }
+    if (check != NULL) {
+        status = pthread_mutex_unlock (&advance_mutex);
+        if (status != 0)
+            err_abort (status, "Unlock epoch advance");
+        return;
+    }
+    retired = atomic_exchange (&limbo[(epoch + 1) % EPOCH_LISTS], NULL);
+    atomic_store (&global_epoch, epoch + 1);
+    status = pthread_mutex_unlock (&advance_mutex);
+    if (status != 0)
+        err_abort (status, "Unlock epoch advance");
+
+    for (; retired != NULL; retired = next) {
+        next = retired->next;
+        retired->reclaim (retired);
+    }
+}
+
+/*
+ * The object goes on the limbo list of the epoch the caller is in,
+ * which cannot be reclaimed until the caller has left its bracket.
+ */
+void epoch_retire (
+    epoch_retired_t *retired, void (*reclaim)(epoch_retired_t*))
+{
+    _Atomic (epoch_retired_t*) *list;
+
+    retired->reclaim = reclaim;
+    epoch_enter ();
+    list = &limbo[(atomic_load (&record->state) >> 1) % EPOCH_LISTS];
+    retired->next = atomic_load (list);
+    while (!atomic_compare_exchange_weak (list, &retired->next, retired))
+        ;
+    epoch_exit ();
+    if (atomic_fetch_add (&retire_count, 1) % EPOCH_BATCH == EPOCH_BATCH - 1)
+        epoch_advance ();
+}
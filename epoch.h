@@ -0,0 +1,35 @@
+#ifndef __epoch_h
+#define __epoch_h
+
+#include <stdatomic.h>
+
+/*
+ * Epoch-based reclamation, for lock-free structures whose readers
+ * may still be looking at a node after a writer has unlinked it.
+ *
+ * Every access to such a structure is bracketed by epoch_enter and
+ * epoch_exit. A node that has been unlinked is handed to
+ * epoch_retire instead of being freed, and its reclaim function is
+ * called once every thread that was inside a bracket at the time has
+ * left it, when no thread can still hold a pointer to it:
+ *
+ *      epoch_enter ();
+ *      ... find and unlink node ...
+ *      epoch_retire (&node->retired, node_reclaim);
+ *      epoch_exit ();
+ *
+ * Brackets nest, and epoch_retire may also be called outside one.
+ * The epoch_retired_t lives in the retired object, so retiring never
+ * allocates memory.
+ */
+typedef struct epoch_retired_tag {
+    struct epoch_retired_tag *next;
+    void                (*reclaim)(struct epoch_retired_tag *retired);
+} epoch_retired_t;
+
+extern void epoch_enter (void);
+extern void epoch_exit (void);
+extern void epoch_retire (
+    epoch_retired_t *retired, void (*reclaim)(epoch_retired_t*));
+
+#endif
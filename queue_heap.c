@@ -0,0 +1,43 @@
+/*
+ * queue_heap.c
+ *
+ * The binary heap deadline queue (ALARM_QUEUE_HEAP); see
+ * alarm_queue.h. It is a thin layer over deadline_heap.
+ */
+#include "errors.h"
+#include "alarm_queue.h"
+
+int alarm_queue_init (alarm_queue_t *queue, int size)
+{
+    return deadline_heap_init (&queue->heap, size);
+}
+
+void alarm_queue_destroy (alarm_queue_t *queue)
+{
+    deadline_heap_destroy (&queue->heap);
+}
+
+int alarm_queue_push (alarm_queue_t *queue, deadline_node_t *node)
+{
+    return deadline_heap_push (&queue->heap, node);
+}
+
+void alarm_queue_remove (alarm_queue_t *queue, deadline_node_t *node)
+{
+    deadline_heap_remove (&queue->heap, node);
+}
+
+deadline_node_t *alarm_queue_peek (alarm_queue_t *queue)
+{
+    return deadline_heap_peek (&queue->heap);
+}
+
+deadline_node_t *alarm_queue_pop (alarm_queue_t *queue)
+{
+    return deadline_heap_pop (&queue->heap);
+}
+
+int alarm_queue_smallest (alarm_queue_t *queue, deadline_node_t **out, int n)
+{
+    return deadline_heap_smallest (&queue->heap, out, n);
+}
@@ -0,0 +1,253 @@
+/*
+ * queue_hybrid.c
+ *
+ * The hybrid deadline queue (ALARM_QUEUE_HYBRID); see alarm_queue.h.
+ *
+ * Alarm periods run from a tenth of a second to a month. A wheel
+ * alone either has slots too coarse for the short ones or turns
+ * through millions of empty slots for the long ones, and a heap
+ * alone pays log n on every fire of the short ones, which fire the
+ * most. Here the wheel only covers the next turn, where pushing and
+ * removing a node are O(1), and anything due later waits in far.
+ * Each node leaves far at most once, when the wheel turns to within
+ * a turn of it, so a month-long alarm pays log n once per period
+ * and a short one never does.
+ *
+ * The wheel turns a tick at a time, skipping empty slots through
+ * the occupied bitmap, and empties each slot it turns to into due,
+ * where the nodes of that one tick come out in order in log of
+ * their number, however many the whole queue holds.
+ */
+#include "errors.h"
+#include "alarm_queue.h"
+
+#define WHEEL_MASK      (ALARM_WHEEL_SLOTS - 1)
+
+#define node_tick(node) ((node)->deadline / ALARM_WHEEL_TICK)
+
+static void wheel_link (alarm_queue_t *queue, deadline_node_t *node)
+{
+    int slot = node_tick (node) & WHEEL_MASK;
+    deadline_node_t **list = &queue->slots[slot];
+
+    node->index = ALARM_HYBRID_SLOT (slot);
+    node->prev = NULL;
+    node->next = *list;
+    if (*list != NULL)
+        (*list)->prev = node;
+    else
+        queue->occupied[slot / 64] |= (uint64_t)1 << (slot % 64);
+    *list = node;
+    queue->near++;
+}
+
+static void wheel_unlink (alarm_queue_t *queue, deadline_node_t *node)
+{
+    int slot = -2 - node->index;
+
+    if (node->prev == NULL) {
+        queue->slots[slot] = node->next;
+        if (node->next == NULL)
+            queue->occupied[slot / 64] &= ~((uint64_t)1 << (slot % 64));
+    } else
+        node->prev->next = node->next;
+    if (node->next != NULL)
+        node->next->prev = node->prev;
+    node->index = -1;
+    queue->near--;
+}
+
+/*
+ * Move every node in far that the wheel now reaches onto it.
+ */
+static void migrate (alarm_queue_t *queue)
+{
+    deadline_node_t *node;
+
+    while ((node = deadline_heap_peek (&queue->far)) != NULL
+            && node_tick (node) < queue->base + ALARM_WHEEL_SLOTS) {
+        deadline_heap_pop (&queue->far);
+        wheel_link (queue, node);
+    }
+}
+
+/*
+ * The first occupied slot from slot from on, going round the wheel.
+ * Some slot must be occupied.
+ */
+static int next_occupied (alarm_queue_t *queue, int from)
+{
+    int word = from / 64;
+    uint64_t bits = queue->occupied[word] & (~(uint64_t)0 << (from % 64));
+
+    while (bits == 0) {
+        word = (word + 1) % ALARM_HYBRID_WORDS;
+        bits = queue->occupied[word];
+    }
+    return 64 * word + __builtin_ctzll (bits);
+}
+
+int alarm_queue_init (alarm_queue_t *queue, int size)
+{
+    int i, status;
+
+    for (i = 0; i < ALARM_WHEEL_SLOTS; i++)
+        queue->slots[i] = NULL;
+    for (i = 0; i < ALARM_HYBRID_WORDS; i++)
+        queue->occupied[i] = 0;
+    queue->base = 0;
+    queue->near = 0;
+    /*
+     * Either heap may hold every node at once, and sized for that
+     * neither ever has to grow, which would allocate on the
+     * dispatcher's path.
+     */
+    status = deadline_heap_init (&queue->due, size);
+    if (status != 0)
+        return status;
+    status = deadline_heap_init (&queue->far, size);
+    if (status != 0)
+        deadline_heap_destroy (&queue->due);
+    return status;
+}
+
+void alarm_queue_destroy (alarm_queue_t *queue)
+{
+    deadline_heap_destroy (&queue->due);
+    deadline_heap_destroy (&queue->far);
+}
+
+int alarm_queue_push (alarm_queue_t *queue, deadline_node_t *node)
+{
+    int64_t tick = node_tick (node);
+
+    if (tick <= queue->base)
+        return deadline_heap_push (&queue->due, node);
+    if (tick < queue->base + ALARM_WHEEL_SLOTS) {
+        wheel_link (queue, node);
+        return 0;
+    }
+    return deadline_heap_push (&queue->far, node);
+}
+
+/*
+ * The base only moves forward, and nothing is put in due after its
+ * tick or in far before the horizon, so a queued node's tick still
+ * says which heap it went to.
+ */
+void alarm_queue_remove (alarm_queue_t *queue, deadline_node_t *node)
+{
+    if (node->index < 0)
+        wheel_unlink (queue, node);
+    else if (node_tick (node) <= queue->base)
+        deadline_heap_remove (&queue->due, node);
+    else
+        deadline_heap_remove (&queue->far, node);
+}
+
+/*
+ * Once due is empty the wheel turns to the first occupied slot,
+ * after jumping straight to the earliest node in far if the wheel is
+ * empty too, empties that slot into due, and takes on whatever in
+ * far it now reaches, all of which is due after that slot.
+ */
+deadline_node_t *alarm_queue_peek (alarm_queue_t *queue)
+{
+    deadline_node_t *node, *next;
+    int slot, status;
+
+    if (queue->due.count > 0)
+        return deadline_heap_peek (&queue->due);
+    if (queue->near == 0) {
+        if (queue->far.count == 0)
+            return NULL;
+        queue->base = node_tick (deadline_heap_peek (&queue->far));
+        migrate (queue);
+    }
+
+    slot = next_occupied (queue, queue->base & WHEEL_MASK);
+    queue->base += (slot - queue->base) & WHEEL_MASK;
+    for (node = queue->slots[slot]; node != NULL; node = next) {
+        next = node->next;
+        queue->near--;
+        node->index = -1;
+        status = deadline_heap_push (&queue->due, node);
+        if (status != 0)
+            err_abort (status, "Queue due alarm");
+    }
+    queue->slots[slot] = NULL;
+    queue->occupied[slot / 64] &= ~((uint64_t)1 << (slot % 64));
+    migrate (queue);
+    return deadline_heap_peek (&queue->due);
+}
+
+deadline_node_t *alarm_queue_pop (alarm_queue_t *queue)
+{
+    deadline_node_t *node = alarm_queue_peek (queue);
+
+    if (node != NULL)
+        deadline_heap_remove (&queue->due, node);
+    return node;
+}
+
+static int node_compare (const void *a, const void *b)
+{
+    deadline_node_t *x = *(deadline_node_t**)a, *y = *(deadline_node_t**)b;
+
+    if (deadline_before (x, y))
+        return -1;
+    return deadline_before (y, x);
+}
+
+/*
+ * Take the earliest from due, then gather each slot of the wheel
+ * from the tick after base on, sorting each on its own, until n
+ * nodes have been found; the rest come from far. The occupied
+ * bitmap skips empty slots 64 at a time.
+ */
+int alarm_queue_smallest (alarm_queue_t *queue, deadline_node_t **out, int n)
+{
+    deadline_node_t **found, *node;
+    int size = queue->due.count + queue->near + queue->far.count;
+    int count, start, more = 0, slot, i;
+
+    if (n > size)
+        n = size;
+    if (n <= 0)
+        return 0;
+    count = deadline_heap_smallest (&queue->due, out, n);
+    if (count < 0)
+        return -1;
+    if (count == n)
+        return count;
+
+    found = (deadline_node_t**)malloc (
+        (queue->near + 1) * sizeof (deadline_node_t*));
+    if (found == NULL)
+        return -1;
+    for (i = 1; i < ALARM_WHEEL_SLOTS && count + more < n; i++) {
+        slot = (queue->base + i) & WHEEL_MASK;
+        if (slot % 64 == 0 && queue->occupied[slot / 64] == 0) {
+            i += 63;
+            continue;
+        }
+        if (queue->slots[slot] == NULL)
+            continue;
+        start = more;
+        for (node = queue->slots[slot]; node != NULL; node = node->next)
+            found[more++] = node;
+        qsort (found + start, more - start,
+            sizeof (deadline_node_t*), node_compare);
+    }
+    for (i = 0; i < more && count < n; i++)
+        out[count++] = found[i];
+    free (found);
+
+    if (count < n) {
+        more = deadline_heap_smallest (&queue->far, out + count, n - count);
+        if (more < 0)
+            return -1;
+        count += more;
+    }
+    return count;
+}
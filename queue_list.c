@@ -0,0 +1,93 @@
+/*
+ * queue_list.c
+ *
+ * The sorted list deadline queue (ALARM_QUEUE_LIST); see
+ * alarm_queue.h.
+ */
+#include "errors.h"
+#include "alarm_queue.h"
+
+int alarm_queue_init (alarm_queue_t *queue, int size)
+{
+    (void)size;
+    queue->head = queue->tail = NULL;
+    queue->count = 0;
+    return 0;
+}
+
+void alarm_queue_destroy (alarm_queue_t *queue)
+{
+    queue->head = queue->tail = NULL;
+    queue->count = 0;
+}
+
+int alarm_queue_push (alarm_queue_t *queue, deadline_node_t *node)
+{
+    deadline_node_t *next;
+
+    /*
+     * Find the first node that belongs after the new one, starting
+     * with the tail: if the new node goes last there is no walk.
+     */
+    if (queue->tail == NULL || !deadline_before (node, queue->tail))
+        next = NULL;
+    else {
+        next = queue->head;
+        while (!deadline_before (node, next))
+            next = next->next;
+    }
+
+    node->next = next;
+    if (next == NULL) {
+        node->prev = queue->tail;
+        queue->tail = node;
+    } else {
+        node->prev = next->prev;
+        next->prev = node;
+    }
+    if (node->prev == NULL)
+        queue->head = node;
+    else
+        node->prev->next = node;
+    node->index = 0;
+    queue->count++;
+    return 0;
+}
+
+void alarm_queue_remove (alarm_queue_t *queue, deadline_node_t *node)
+{
+    if (node->prev == NULL)
+        queue->head = node->next;
+    else
+        node->prev->next = node->next;
+    if (node->next == NULL)
+        queue->tail = node->prev;
+    else
+        node->next->prev = node->prev;
+    node->index = -1;
+    queue->count--;
+}
+
+deadline_node_t *alarm_queue_peek (alarm_queue_t *queue)
+{
+    return queue->head;
+}
+
+deadline_node_t *alarm_queue_pop (alarm_queue_t *queue)
+{
+    deadline_node_t *node = queue->head;
+
+    if (node != NULL)
+        alarm_queue_remove (queue, node);
+    return node;
+}
+
+int alarm_queue_smallest (alarm_queue_t *queue, deadline_node_t **out, int n)
+{
+    deadline_node_t *node;
+    int count = 0;
+
+    for (node = queue->head; node != NULL && count < n; node = node->next)
+        out[count++] = node;
+    return count;
+}
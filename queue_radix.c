@@ -0,0 +1,201 @@
+/*
+ * queue_radix.c
+ *
+ * The radix heap deadline queue (ALARM_QUEUE_RADIX); see
+ * alarm_queue.h.
+ *
+ * The dispatcher only ever takes alarms out in deadline order, and
+ * new deadlines are never earlier than the one it took last (they
+ * are now plus a delay, or a popped deadline plus a period), which
+ * is the case a radix heap is made for. Pushing and removing a node
+ * are O(1) on a bucket's doubly linked list. Popping the earliest
+ * node makes its deadline the new last, and moves the rest of its
+ * bucket down into buckets for lower digits; a node moves down at
+ * most once per hex digit, so popping is amortized O(1) in the
+ * number of nodes, and never compares nodes in different buckets.
+ * Base 16 rather than 2 means a quarter as many moves, each of which
+ * is a cache miss on a large queue, for a few more buckets to skip,
+ * which the occupied bitmap makes cheap.
+ *
+ * Deadlines are compared as unsigned, so they must not be negative.
+ * A node pushed with a deadline before last (if a realtime clock is
+ * stepped back) goes in bucket 0, which is searched first; it is
+ * late, but still comes out in order.
+ */
+#include "errors.h"
+#include "alarm_queue.h"
+
+static int radix_bucket (alarm_queue_t *queue, deadline_node_t *node)
+{
+    uint64_t deadline = (uint64_t)node->deadline;
+    int digit;
+
+    if (deadline <= queue->last)
+        return 0;
+    digit = (63 - __builtin_clzll (deadline ^ queue->last)) / 4;
+    return 1 + 16 * digit + (int)((deadline >> (4 * digit)) & 15);
+}
+
+static void bucket_link (alarm_queue_t *queue, deadline_node_t *node)
+{
+    int bucket = radix_bucket (queue, node);
+    deadline_node_t **list = &queue->buckets[bucket];
+
+    node->index = bucket;
+    node->prev = NULL;
+    node->next = *list;
+    if (*list != NULL)
+        (*list)->prev = node;
+    else
+        queue->occupied[bucket / 64] |= (uint64_t)1 << (bucket % 64);
+    *list = node;
+}
+
+static int first_bucket (alarm_queue_t *queue)
+{
+    int i;
+
+    for (i = 0; queue->occupied[i] == 0; i++)
+        ;
+    return 64 * i + __builtin_ctzll (queue->occupied[i]);
+}
+
+int alarm_queue_init (alarm_queue_t *queue, int size)
+{
+    int i;
+
+    (void)size;
+    for (i = 0; i < ALARM_RADIX_BUCKETS; i++)
+        queue->buckets[i] = NULL;
+    for (i = 0; i < ALARM_RADIX_WORDS; i++)
+        queue->occupied[i] = 0;
+    queue->min = NULL;
+    queue->last = 0;
+    queue->count = 0;
+    return 0;
+}
+
+void alarm_queue_destroy (alarm_queue_t *queue)
+{
+    alarm_queue_init (queue, 0);
+}
+
+int alarm_queue_push (alarm_queue_t *queue, deadline_node_t *node)
+{
+    bucket_link (queue, node);
+    if (queue->min != NULL && deadline_before (node, queue->min))
+        queue->min = node;
+    queue->count++;
+    return 0;
+}
+
+void alarm_queue_remove (alarm_queue_t *queue, deadline_node_t *node)
+{
+    int bucket = node->index;
+
+    if (node->prev == NULL) {
+        queue->buckets[bucket] = node->next;
+        if (node->next == NULL)
+            queue->occupied[bucket / 64] &= ~((uint64_t)1 << (bucket % 64));
+    } else
+        node->prev->next = node->next;
+    if (node->next != NULL)
+        node->next->prev = node->prev;
+    node->index = -1;
+
+    if (queue->min == node)
+        queue->min = NULL;
+    queue->count--;
+}
+
+/*
+ * The earliest node is in the first bucket that has any. Finding it
+ * takes a walk of that bucket, but changes nothing, so that a push
+ * earlier than the earliest node (which the dispatcher has only
+ * peeked at, not taken) still lands in the right bucket.
+ */
+deadline_node_t *alarm_queue_peek (alarm_queue_t *queue)
+{
+    deadline_node_t *node;
+
+    if (queue->min != NULL || queue->count == 0)
+        return queue->min;
+
+    for (node = queue->buckets[first_bucket (queue)];
+            node != NULL; node = node->next)
+        if (queue->min == NULL || deadline_before (node, queue->min))
+            queue->min = node;
+    return queue->min;
+}
+
+deadline_node_t *alarm_queue_pop (alarm_queue_t *queue)
+{
+    deadline_node_t *node = alarm_queue_peek (queue), *next, *list;
+    int bucket;
+
+    if (node == NULL)
+        return NULL;
+    bucket = node->index;
+    alarm_queue_remove (queue, node);
+
+    /*
+     * Everything left in the popped node's bucket now goes in a
+     * lower one. The buckets below were empty, so the earliest of
+     * these is the earliest in the queue, and is cached on the way.
+     */
+    if (bucket > 0) {
+        queue->last = (uint64_t)node->deadline;
+        list = queue->buckets[bucket];
+        queue->buckets[bucket] = NULL;
+        queue->occupied[bucket / 64] &= ~((uint64_t)1 << (bucket % 64));
+        for (; list != NULL; list = next) {
+            next = list->next;
+            bucket_link (queue, list);
+            if (queue->min == NULL || deadline_before (list, queue->min))
+                queue->min = list;
+        }
+    }
+    return node;
+}
+
+static int node_compare (const void *a, const void *b)
+{
+    deadline_node_t *x = *(deadline_node_t**)a, *y = *(deadline_node_t**)b;
+
+    if (deadline_before (x, y))
+        return -1;
+    return deadline_before (y, x);
+}
+
+/*
+ * Gather the nodes a bucket at a time, in bucket order, sorting
+ * each bucket on its own, until n nodes have been found.
+ */
+int alarm_queue_smallest (alarm_queue_t *queue, deadline_node_t **out, int n)
+{
+    deadline_node_t **found, *node;
+    int size = queue->count, count = 0, start, i;
+
+    if (n > size)
+        n = size;
+    if (n <= 0)
+        return 0;
+    found = (deadline_node_t**)malloc (size * sizeof (deadline_node_t*));
+    if (found == NULL)
+        return -1;
+
+    for (i = 0; i < ALARM_RADIX_BUCKETS && count < n; i++) {
+        start = count;
+        for (node = queue->buckets[i]; node != NULL; node = node->next)
+            found[count++] = node;
+        qsort (found + start, count - start,
+            sizeof (deadline_node_t*), node_compare);
+    }
+
+    if (count > n)
+        count = n;
+    for (i = 0; i < count; i++)
+        out[i] = found[i];
+    free (found);
+    return count;
+}
@@ -0,0 +1,199 @@
+/*
+ * queue_wheel.c
+ *
+ * The timing wheel deadline queue (ALARM_QUEUE_WHEEL); see
+ * alarm_queue.h.
+ *
+ * Pushing and removing a node are O(1): each slot is an unsorted
+ * doubly linked list. Finding the earliest node turns the wheel
+ * from base to the first tick that has a node due in it, which is
+ * cheap when deadlines are dense and near, as the wheel is meant
+ * for. The result is cached until the queue changes under it. If
+ * nothing at all is due within one turn of the wheel, every node is
+ * examined and the wheel jumps straight to the earliest.
+ */
+#include "errors.h"
+#include "alarm_queue.h"
+
+#define WHEEL_MASK      (ALARM_WHEEL_SLOTS - 1)
+#define WHEEL_LATE      ALARM_WHEEL_SLOTS
+
+#define node_tick(node) ((node)->deadline / ALARM_WHEEL_TICK)
+
+static deadline_node_t **wheel_list (alarm_queue_t *queue, int index)
+{
+    return index == WHEEL_LATE ? &queue->late : &queue->slots[index];
+}
+
+int alarm_queue_init (alarm_queue_t *queue, int size)
+{
+    int i;
+
+    (void)size;
+    for (i = 0; i < ALARM_WHEEL_SLOTS; i++)
+        queue->slots[i] = NULL;
+    queue->late = NULL;
+    queue->min = NULL;
+    queue->base = 0;
+    queue->count = 0;
+    return 0;
+}
+
+void alarm_queue_destroy (alarm_queue_t *queue)
+{
+    alarm_queue_init (queue, 0);
+}
+
+int alarm_queue_push (alarm_queue_t *queue, deadline_node_t *node)
+{
+    deadline_node_t **list;
+
+    if (node_tick (node) < queue->base)
+        node->index = WHEEL_LATE;
+    else
+        node->index = node_tick (node) & WHEEL_MASK;
+    list = wheel_list (queue, node->index);
+    node->prev = NULL;
+    node->next = *list;
+    if (*list != NULL)
+        (*list)->prev = node;
+    *list = node;
+
+    if (queue->min != NULL && deadline_before (node, queue->min))
+        queue->min = node;
+    queue->count++;
+    return 0;
+}
+
+void alarm_queue_remove (alarm_queue_t *queue, deadline_node_t *node)
+{
+    if (node->prev == NULL)
+        *wheel_list (queue, node->index) = node->next;
+    else
+        node->prev->next = node->next;
+    if (node->next != NULL)
+        node->next->prev = node->prev;
+    node->index = -1;
+
+    if (queue->min == node)
+        queue->min = NULL;
+    queue->count--;
+}
+
+/*
+ * The earliest node on list whose tick is tick, or on any tick if
+ * tick is -1.
+ */
+static deadline_node_t *list_earliest (deadline_node_t *list, int64_t tick)
+{
+    deadline_node_t *best = NULL;
+
+    for (; list != NULL; list = list->next) {
+        if (tick >= 0 && node_tick (list) != tick)
+            continue;
+        if (best == NULL || deadline_before (list, best))
+            best = list;
+    }
+    return best;
+}
+
+deadline_node_t *alarm_queue_peek (alarm_queue_t *queue)
+{
+    deadline_node_t *best, *node;
+    int64_t tick;
+    int i;
+
+    if (queue->min != NULL || queue->count == 0)
+        return queue->min;
+
+    best = list_earliest (queue->late, -1);
+    if (best != NULL)
+        return queue->min = best;
+
+    for (tick = queue->base; tick < queue->base + ALARM_WHEEL_SLOTS; tick++) {
+        best = list_earliest (queue->slots[tick & WHEEL_MASK], tick);
+        if (best != NULL) {
+            queue->base = tick;
+            return queue->min = best;
+        }
+    }
+
+    for (i = 0; i < ALARM_WHEEL_SLOTS; i++) {
+        node = list_earliest (queue->slots[i], -1);
+        if (node != NULL && (best == NULL || deadline_before (node, best)))
+            best = node;
+    }
+    queue->base = node_tick (best);
+    return queue->min = best;
+}
+
+deadline_node_t *alarm_queue_pop (alarm_queue_t *queue)
+{
+    deadline_node_t *node = alarm_queue_peek (queue);
+
+    if (node != NULL)
+        alarm_queue_remove (queue, node);
+    return node;
+}
+
+static int node_compare (const void *a, const void *b)
+{
+    deadline_node_t *x = *(deadline_node_t**)a, *y = *(deadline_node_t**)b;
+
+    if (deadline_before (x, y))
+        return -1;
+    return deadline_before (y, x);
+}
+
+/*
+ * Gather the nodes in the order the wheel would give them out: the
+ * late list, then each tick of the next turn of the wheel, then
+ * everything further out. Each group is sorted on its own, and the
+ * walk stops as soon as n nodes have been found.
+ */
+int alarm_queue_smallest (alarm_queue_t *queue, deadline_node_t **out, int n)
+{
+    deadline_node_t **found, *node;
+    int64_t base = queue->base, tick;
+    int size = queue->count, count = 0, start, i;
+
+    if (n > size)
+        n = size;
+    if (n <= 0)
+        return 0;
+    found = (deadline_node_t**)malloc (size * sizeof (deadline_node_t*));
+    if (found == NULL)
+        return -1;
+
+    for (node = queue->late; node != NULL && count < size; node = node->next)
+        found[count++] = node;
+    qsort (found, count, sizeof (deadline_node_t*), node_compare);
+
+    for (tick = base; tick < base + ALARM_WHEEL_SLOTS && count < n; tick++) {
+        start = count;
+        for (node = queue->slots[tick & WHEEL_MASK];
+                node != NULL && count < size; node = node->next)
+            if (node_tick (node) == tick)
+                found[count++] = node;
+        qsort (found + start, count - start,
+            sizeof (deadline_node_t*), node_compare);
+    }
+
+    if (count < n) {
+        start = count;
+        for (i = 0; i < ALARM_WHEEL_SLOTS; i++)
+            for (node = queue->slots[i];
+                    node != NULL && count < size; node = node->next)
+                if (node_tick (node) >= base + ALARM_WHEEL_SLOTS)
+                    found[count++] = node;
+        qsort (found + start, count - start,
+            sizeof (deadline_node_t*), node_compare);
+    }
+
+    if (count > n)
+        count = n;
+    for (i = 0; i < count; i++)
+        out[i] = found[i];
+    free (found);
+    return count;
+}
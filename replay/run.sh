@@ -0,0 +1,48 @@
+#!/bin/sh
+#
+# run.sh
+#
+# Replay each scenario in replay/ through New_Alarm_Cond built for
+# replay (-DALARM_REPLAY, on the virtual clock), compare everything
+# it prints with the scenario's golden output, and report the CPU
+# time each scenario took, one line per scenario:
+#
+#       scenario result cpu_seconds
+#
+# A scenario, name.in, is a list of "@t command" lines; its golden
+# output is name.out. Run from the top of the tree, usually as "make
+# replay". With -u the golden outputs are rewritten from this run
+# instead of compared; check the diff before committing them.
+#
+# Environment:
+#       PROGRAM     The replay build
+#                   (default build/index-list/replay/New_Alarm_Cond)
+
+PROGRAM=${PROGRAM:-build/index-list/replay/New_Alarm_Cond}
+update=0
+if [ "$1" = "-u" ]; then
+  update=1
+fi
+
+mkdir -p build/replay
+failed=0
+echo "scenario result cpu_seconds"
+for input in replay/*.in; do
+  name=`basename $input .in`
+  output=build/replay/$name.out
+  $PROGRAM < $input > $output.raw 2>&1
+  cpu=`sed -n 's/^# cpu //p' $output.raw`
+  grep -v '^# cpu ' $output.raw > $output
+  if [ $update = 1 ]; then
+    cp $output replay/$name.out
+    result=updated
+  elif cmp -s $output replay/$name.out; then
+    result=pass
+  else
+    diff replay/$name.out $output >&2
+    result=FAIL
+    failed=1
+  fi
+  echo "$name $result $cpu"
+done
+exit $failed
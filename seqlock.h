@@ -0,0 +1,68 @@
+#ifndef __seqlock_h
+#define __seqlock_h
+
+#include <stdatomic.h>
+
+/*
+ * A sequence lock protects a small block of data that is written
+ * rarely and read often. A writer makes the sequence odd while it
+ * updates the data and even again when it is done; a reader copies
+ * the data and retries if the sequence was odd, or changed, while it
+ * was copying. Readers never block writers and never write shared
+ * memory, so any number of them can read without a lock.
+ *
+ * Writers are not serialized against each other by the sequence
+ * lock itself; the caller must hold some other lock around
+ * seqlock_write_begin ... seqlock_write_end.
+ *
+ *      do {
+ *          seq = seqlock_read_begin (&lock);
+ *          copy = data;
+ *      } while (seqlock_read_retry (&lock, seq));
+ */
+typedef struct seqlock_tag {
+    atomic_uint         sequence;
+} seqlock_t;
+
+#define SEQLOCK_INITIALIZER { 0 }
+
+static inline void seqlock_init (seqlock_t *lock)
+{
+    atomic_init (&lock->sequence, 0);
+}
+
+static inline unsigned seqlock_read_begin (seqlock_t *lock)
+{
+    unsigned seq;
+
+    while ((seq = atomic_load_explicit (
+            &lock->sequence, memory_order_acquire)) & 1)
+        ;
+    return seq;
+}
+
+static inline int seqlock_read_retry (seqlock_t *lock, unsigned seq)
+{
+    atomic_thread_fence (memory_order_acquire);
+    return atomic_load_explicit (
+        &lock->sequence, memory_order_relaxed) != seq;
+}
+
+static inline void seqlock_write_begin (seqlock_t *lock)
+{
+    unsigned seq = atomic_load_explicit (
+        &lock->sequence, memory_order_relaxed);
+
+    atomic_store_explicit (&lock->sequence, seq + 1, memory_order_relaxed);
+    atomic_thread_fence (memory_order_release);
+}
+
+static inline void seqlock_write_end (seqlock_t *lock)
+{
+    unsigned seq = atomic_load_explicit (
+        &lock->sequence, memory_order_relaxed);
+
+    atomic_store_explicit (&lock->sequence, seq + 1, memory_order_release);
+}
+
+#endif
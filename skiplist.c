@@ -0,0 +1,279 @@
+/*
+ * skiplist.c
+ *
+ * The lock-free skip list; see skiplist.h. This is the list of
+ * Herlihy and Shavit ("The Art of Multiprocessor Programming",
+ * chapter 14), with marks kept in the low bit of each link.
+ *
+ * A node is linked at the bottom level first, which is what makes it
+ * present, and then level by level upwards. Its remover marks it
+ * from the top down, so an inserter still linking it upwards finds
+ * its next link marked and stops. But the inserter may already have
+ * linked the level it was at just before the mark, after the
+ * remover's last search went past, so each node has two owners: the
+ * list, whose reference the remover drops, and the inserter, which
+ * searches once more to unlink any such level before dropping its
+ * own. The node is retired when both are done with it.
+ */
+#include <limits.h>
+#include <pthread.h>
+#include <stddef.h>
+#include "errors.h"
+#include "skiplist.h"
+
+#define MARKED(link)    ((link) & 1)
+#define NODE(link)      ((skiplist_node_t*)((link) & ~(uintptr_t)1))
+
+static skiplist_node_t *node_new (int key, void *value, int height)
+{
+    skiplist_node_t *node;
+
+    node = (skiplist_node_t*)malloc (
+        sizeof (skiplist_node_t) + height * sizeof (node->next[0]));
+    if (node == NULL)
+        return NULL;
+    node->key = key;
+    node->height = height;
+    node->value = value;
+    atomic_init (&node->owners, 2);
+    return node;
+}
+
+static void node_reclaim (epoch_retired_t *retired)
+{
+    free ((char*)retired - offsetof (skiplist_node_t, retired));
+}
+
+static void node_release (skiplist_node_t *node)
+{
+    if (atomic_fetch_sub (&node->owners, 1) == 1)
+        epoch_retire (&node->retired, node_reclaim);
+}
+
+/*
+ * Heights are 1 + the number of leading coin tosses won, at odds of
+ * one in four, from a per-thread xorshift generator.
+ */
+static int random_height (void)
+{
+    static __thread uint32_t seed = 0;
+    int height = 1;
+
+    if (seed == 0)
+        seed = (uint32_t)(uintptr_t)&seed | 1;
+    seed ^= seed << 13;
+    seed ^= seed >> 17;
+    seed ^= seed << 5;
+    while (height < SKIPLIST_LEVELS && ((seed >> (2 * height)) & 3) == 0)
+        height++;
+    return height;
+}
+
+int skiplist_init (skiplist_t *list)
+{
+    int level;
+
+    list->head = node_new (0, NULL, SKIPLIST_LEVELS);
+    if (list->head == NULL)
+        return ENOMEM;
+    for (level = 0; level < SKIPLIST_LEVELS; level++)
+        atomic_init (&list->head->next[level], 0);
+    return 0;
+}
+
+/*
+ * Find, at each level, the last node before key and the first at or
+ * after it, unlinking every marked node on the way. Returns whether
+ * the bottom level holds key. Must be called inside a bracket.
+ */
+static int search (skiplist_t *list, int key,
+    skiplist_node_t **preds, skiplist_node_t **succs)
+{
+    skiplist_node_t *pred, *curr;
+    uintptr_t link, expected;
+    int level;
+
+retry:
+    pred = list->head;
+    for (level = SKIPLIST_LEVELS - 1; level >= 0; level--) {
+        curr = NODE (atomic_load (&pred->next[level]));
+        while (curr != NULL) {
+            link = atomic_load (&curr->next[level]);
+            if (MARKED (link)) {
+                /*
+                 * Unlink curr, unless pred has changed (or been
+                 * removed itself), in which case start again.
+                 */
+                expected = (uintptr_t)curr;
+                if (!atomic_compare_exchange_strong (
+                        &pred->next[level], &expected, (uintptr_t)NODE (link)))
+                    goto retry;
+                curr = NODE (link);
+                continue;
+            }
+            if (curr->key >= key)
+                break;
+            pred = curr;
+            curr = NODE (link);
+        }
+        preds[level] = pred;
+        succs[level] = curr;
+    }
+    return succs[0] != NULL && succs[0]->key == key;
+}
+
+/*
+ * Returns 0, EEXIST if key is already present, or ENOMEM.
+ */
+int skiplist_insert (skiplist_t *list, int key, void *value)
+{
+    skiplist_node_t *preds[SKIPLIST_LEVELS], *succs[SKIPLIST_LEVELS];
+    skiplist_node_t *node = NULL;
+    uintptr_t expected, link;
+    int height = random_height (), level;
+
+    epoch_enter ();
+    while (1) {
+        if (search (list, key, preds, succs)) {
+            epoch_exit ();
+            free (node);
+            return EEXIST;
+        }
+        if (node == NULL) {
+            node = node_new (key, value, height);
+            if (node == NULL) {
+                epoch_exit ();
+                return ENOMEM;
+            }
+        }
+        for (level = 0; level < height; level++)
+            atomic_store (&node->next[level], (uintptr_t)succs[level]);
+        expected = (uintptr_t)succs[0];
+        if (atomic_compare_exchange_strong (
+                &preds[0]->next[0], &expected, (uintptr_t)node))
+            break;
+    }
+
+    for (level = 1; level < height; level++) {
+        while (1) {
+            link = atomic_load (&node->next[level]);
+            if (MARKED (link))
+                goto done;
+            if (NODE (link) != succs[level]
+                && !atomic_compare_exchange_strong (
+                    &node->next[level], &link, (uintptr_t)succs[level]))
+                continue;
+            expected = (uintptr_t)succs[level];
+            if (atomic_compare_exchange_strong (
+                    &preds[level]->next[level], &expected, (uintptr_t)node))
+                break;
+            search (list, key, preds, succs);
+            if (succs[0] != node)
+                goto done;
+        }
+    }
+
+done:
+    if (MARKED (atomic_load (&node->next[0])))
+        search (list, key, preds, succs);
+    node_release (node);
+    epoch_exit ();
+    return 0;
+}
+
+/*
+ * Returns the value stored under key, or NULL. Only reads, so it
+ * steps over marked nodes rather than unlinking them.
+ */
+void *skiplist_find (skiplist_t *list, int key)
+{
+    skiplist_node_t *pred, *curr = NULL;
+    uintptr_t link;
+    void *value = NULL;
+    int level;
+
+    epoch_enter ();
+    pred = list->head;
+    for (level = SKIPLIST_LEVELS - 1; level >= 0; level--) {
+        curr = NODE (atomic_load (&pred->next[level]));
+        while (curr != NULL && curr->key < key) {
+            pred = curr;
+            curr = NODE (atomic_load (&curr->next[level]));
+        }
+    }
+    for (; curr != NULL && curr->key == key; curr = NODE (link)) {
+        link = atomic_load (&curr->next[0]);
+        if (!MARKED (link)) {
+            value = curr->value;
+            break;
+        }
+    }
+    epoch_exit ();
+    return value;
+}
+
+/*
+ * Removes key, if it is present and (unless value is NULL) stored
+ * with value. Returns the value removed, or NULL if this call did
+ * not remove anything.
+ */
+void *skiplist_remove (skiplist_t *list, int key, void *value)
+{
+    skiplist_node_t *preds[SKIPLIST_LEVELS], *succs[SKIPLIST_LEVELS];
+    skiplist_node_t *node;
+    uintptr_t link;
+    int level;
+
+    epoch_enter ();
+    if (!search (list, key, preds, succs)
+        || (value != NULL && succs[0]->value != value)) {
+        epoch_exit ();
+        return NULL;
+    }
+    node = succs[0];
+    for (level = node->height - 1; level > 0; level--) {
+        link = atomic_load (&node->next[level]);
+        while (!MARKED (link) && !atomic_compare_exchange_weak (
+                &node->next[level], &link, link | 1))
+            ;
+    }
+    link = atomic_load (&node->next[0]);
+    while (1) {
+        if (MARKED (link)) {
+            epoch_exit ();
+            return NULL;
+        }
+        if (atomic_compare_exchange_weak (&node->next[0], &link, link | 1))
+            break;
+    }
+    search (list, key, preds, succs);
+    value = node->value;
+    node_release (node);
+    epoch_exit ();
+    return value;
+}
+
+/*
+ * Stores the values of up to max keys above after in values, in key
+ * order, and returns how many were stored. Nodes removed while the
+ * scan is under way may or may not be included.
+ */
+int skiplist_scan (skiplist_t *list, int after, void **values, int max)
+{
+    skiplist_node_t *preds[SKIPLIST_LEVELS], *succs[SKIPLIST_LEVELS];
+    skiplist_node_t *curr;
+    uintptr_t link;
+    int count = 0;
+
+    if (after == INT_MAX)
+        return 0;
+    epoch_enter ();
+    search (list, after + 1, preds, succs);
+    for (curr = succs[0]; curr != NULL && count < max; curr = NODE (link)) {
+        link = atomic_load (&curr->next[0]);
+        if (!MARKED (link))
+            values[count++] = curr->value;
+    }
+    epoch_exit ();
+    return count;
+}
@@ -0,0 +1,47 @@
+#ifndef __skiplist_h
+#define __skiplist_h
+
+#include <stdatomic.h>
+#include <stdint.h>
+#include "epoch.h"
+
+/*
+ * A lock-free skip list mapping int keys to pointers, kept in key
+ * order. Any number of threads may insert, look up, remove and scan
+ * at once; none of them ever waits for another.
+ *
+ * A node is removed by marking its links (the low bit of each next
+ * pointer) from the top level down; whoever marks the bottom link
+ * has removed it. Marked nodes are unlinked by whichever thread next
+ * passes them while searching, and reclaimed through epoch.h, so a
+ * thread walking the list may still step onto a node that has just
+ * been removed and carry on from it safely.
+ *
+ * Every call brackets itself with epoch_enter and epoch_exit. A
+ * value returned by skiplist_find or skiplist_scan is only the
+ * caller's to use while its own bracket lasts, if values are also
+ * retired through epoch.h.
+ */
+#define SKIPLIST_LEVELS         16      /* Enough for 4^16 keys */
+
+typedef struct skiplist_node_tag {
+    int                 key;
+    int                 height;
+    void                *value;
+    atomic_int          owners; /* The list, and the inserting thread */
+    epoch_retired_t     retired;
+    _Atomic (uintptr_t) next[]; /* Low bit set once removed */
+} skiplist_node_t;
+
+typedef struct skiplist_tag {
+    skiplist_node_t     *head;
+} skiplist_t;
+
+extern int skiplist_init (skiplist_t *list);
+extern int skiplist_insert (skiplist_t *list, int key, void *value);
+extern void *skiplist_find (skiplist_t *list, int key);
+extern void *skiplist_remove (skiplist_t *list, int key, void *value);
+extern int skiplist_scan (
+    skiplist_t *list, int after, void **values, int max);
+
+#endif
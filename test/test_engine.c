@@ -0,0 +1,143 @@
+/*
+ * test_engine.c
+ *
+ * Regression tests of the alarm engine (alarm_engine.h). Each test
+ * runs against a fresh engine and aborts, with a message, on the
+ * first check that fails; a watchdog alarm kills the run if a test
+ * hangs. "make test" builds and runs it for the engine variant.
+ */
+#include <signal.h>
+#include <stdatomic.h>
+#include "errors.h"
+#include "alarm_config.h"
+#include "alarm_engine.h"
+
+#if ALARM_CLOCK == ALARM_CLOCK_VIRTUAL
+# error "test_engine waits on real time, and needs a real clock"
+#endif
+
+#define MS              ((int64_t)1000000)
+#define WATCHDOG        10      /* Seconds before a hang is a failure */
+
+#define check(condition) \
+    do { \
+        if (!(condition)) { \
+            fprintf (stderr, "%s:%d: check failed: %s\n", \
+                __FILE__, __LINE__, #condition); \
+            abort (); \
+        } \
+    } while (0)
+
+static alarm_engine_t *engine;
+static atomic_int fired[3], dropped[3];
+
+/* The payload of each test alarm: its number, and whom to cancel. */
+typedef struct sibling_tag {
+    int                 number;
+    int                 cancel; /* Alarm to cancel when fired, or 0 */
+} sibling_t;
+
+static void sibling_fire (alarm_entry_t *entry, void *payload)
+{
+    sibling_t *sibling = (sibling_t*)payload;
+
+    (void)entry;
+    atomic_fetch_add (&fired[sibling->number], 1);
+    if (sibling->cancel != 0) {
+        /* Give the dispatcher time to take the sibling too. */
+        usleep (20000);
+        check (alarm_engine_cancel (engine, sibling->cancel) == 0);
+    }
+}
+
+static void sibling_drop (void *payload)
+{
+    atomic_fetch_add (&dropped[((sibling_t*)payload)->number], 1);
+}
+
+static void sibling_schedule (int number, int cancel, int64_t deadline)
+{
+    alarm_entry_t *entry = alarm_engine_alloc (engine);
+    sibling_t *sibling;
+
+    check (entry != NULL);
+    entry->fire = sibling_fire;
+    entry->drop = sibling_drop;
+    sibling = (sibling_t*)entry->payload.bytes;
+    sibling->number = number;
+    sibling->cancel = cancel;
+    check (alarm_engine_schedule_at (engine, entry, number, deadline, 0) == 0);
+}
+
+/*
+ * Alarms 1 and 2 fall due together, and 1's callback cancels 2,
+ * which by then has been taken off the queue to fire, on the ready
+ * ring or later in the same batch as 1. The cancel must not wait
+ * for 2's callback, which could only run after 1's returns; 2 must
+ * not fire, and must be dropped once.
+ */
+static void test_cancel_sibling (const char *name, int workers, int batch)
+{
+    alarm_engine_attr_t attr;
+    int64_t deadline;
+    int i;
+
+    alarm_engine_attr_init (&attr);
+    attr.workers = workers;
+    attr.batch = batch;
+    check (alarm_engine_create (&engine, &attr) == 0);
+    for (i = 0; i < 3; i++) {
+        atomic_store (&fired[i], 0);
+        atomic_store (&dropped[i], 0);
+    }
+    deadline = alarm_engine_now () + 10 * MS;
+    sibling_schedule (1, 2, deadline);
+    sibling_schedule (2, 0, deadline);
+
+    while (atomic_load (&dropped[1]) == 0 || atomic_load (&dropped[2]) == 0)
+        usleep (1000);
+    check (atomic_load (&fired[1]) == 1);
+    check (atomic_load (&fired[2]) == 0);
+    check (atomic_load (&dropped[2]) == 1);
+    check (alarm_engine_cancel (engine, 2) == ENOENT);
+
+    /* Its number is free again at once. */
+    sibling_schedule (2, 0, alarm_engine_now ());
+    while (atomic_load (&dropped[2]) < 2)
+        usleep (1000);
+    check (atomic_load (&fired[2]) == 1);
+    check (alarm_engine_destroy (engine) == 0);
+    printf ("%s ok\n", name);
+}
+
+/*
+ * Real-time mode refuses batching and an elastic pool, which would
+ * allocate while alarms fire. The checks come before any privilege
+ * is needed, so this runs unprivileged.
+ */
+static void test_realtime_refuses_allocation (void)
+{
+    alarm_engine_attr_t attr;
+
+    alarm_engine_attr_init (&attr);
+    attr.realtime = 1;
+    attr.batch = 8;
+    check (alarm_engine_create (&engine, &attr) == EINVAL);
+    attr.batch = 0;
+    attr.workers = 1;
+    attr.max_workers = 2;
+    check (alarm_engine_create (&engine, &attr) == EINVAL);
+    attr.max_workers = ALARM_ENGINE_CPUS;
+    check (alarm_engine_create (&engine, &attr) == EINVAL);
+    printf ("realtime_refuses_allocation ok\n");
+}
+
+int main (void)
+{
+    alarm (WATCHDOG);
+    test_cancel_sibling ("cancel_sibling_worker", 1, 0);
+    test_cancel_sibling ("cancel_sibling_batch", 0, 1);
+    test_cancel_sibling ("cancel_sibling_batch_chunk", 1, 8);
+    test_realtime_refuses_allocation ();
+    return 0;
+}
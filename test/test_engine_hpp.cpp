@@ -0,0 +1,126 @@
+/*
+ * test_engine_hpp.cpp
+ *
+ * Tests of the C++ interface to the alarm engine (alarm_engine.hpp):
+ * a handle cancels its alarm when it goes out of scope, ownership
+ * moves with the handle, and a handle whose one-shot alarm has fired
+ * does not cancel a later alarm given the same message number. Like
+ * test_engine.c, it aborts on the first check that fails, and a
+ * watchdog kills it if it hangs (a thread, since alarm(2) and the
+ * alarm namespace cannot both be declared); "make test" runs both.
+ */
+#include <atomic>
+#include <chrono>
+#include <cstdio>
+#include <cstdlib>
+#include <thread>
+#include "alarm_engine.hpp"
+
+using namespace std::chrono;
+
+#define WATCHDOG        10      /* Seconds before a hang is a failure */
+
+#define check(condition) \
+    do { \
+        if (!(condition)) { \
+            std::fprintf (stderr, "%s:%d: check failed: %s\n", \
+                __FILE__, __LINE__, #condition); \
+            std::abort (); \
+        } \
+    } while (0)
+
+/* Wait until count reaches at least n. */
+static void wait_for (const std::atomic<int> &count, int n)
+{
+    while (count.load () < n)
+        std::this_thread::sleep_for (milliseconds (1));
+}
+
+/* A periodic alarm stops firing when its handle goes out of scope. */
+static void test_scope ()
+{
+    alarm::engine engine;
+    std::atomic<int> ticks (0);
+    int seen;
+
+    {
+        alarm::handle tick = engine.schedule (
+            1, milliseconds (0), milliseconds (1), [&] { ++ticks; });
+        check (tick);
+        wait_for (ticks, 3);
+    }
+    seen = ticks.load ();
+    std::this_thread::sleep_for (milliseconds (20));
+    check (ticks.load () == seen);
+    std::printf ("scope ok\n");
+}
+
+/*
+ * Moving a handle moves the alarm: the moved-from handle cancels
+ * nothing, and assigning over a handle cancels the alarm it had.
+ */
+static void test_move ()
+{
+    alarm::engine engine;
+    std::atomic<int> a (0), b (0);
+    int seen;
+
+    alarm::handle first = engine.schedule (
+        1, milliseconds (0), milliseconds (1), [&] { ++a; });
+    alarm::handle second (std::move (first));
+    check (!first && second);
+    first.cancel ();
+    wait_for (a, 3);
+
+    alarm::handle other = engine.schedule (
+        2, milliseconds (0), milliseconds (1), [&] { ++b; });
+    second = std::move (other);
+    check (second.id () == 2 && !other);
+    seen = a.load ();
+    std::this_thread::sleep_for (milliseconds (20));
+    check (a.load () == seen);
+    wait_for (b, 3);
+
+    second.cancel ();
+    check (!second);
+    seen = b.load ();
+    std::this_thread::sleep_for (milliseconds (20));
+    check (b.load () == seen);
+    std::printf ("move ok\n");
+}
+
+/*
+ * A one-shot alarm fires, and its number (and its entry) goes to a
+ * new alarm; the old handle must not cancel the new alarm.
+ */
+static void test_reuse ()
+{
+    alarm::engine engine;
+    std::atomic<int> a (0), b (0);
+
+    alarm::handle first = engine.schedule (
+        7, milliseconds (0), milliseconds (0), [&] { ++a; });
+    wait_for (a, 1);
+    /* The entry goes back to the pool just after the callback. */
+    std::this_thread::sleep_for (milliseconds (10));
+
+    alarm::handle second = engine.schedule (
+        7, milliseconds (20), milliseconds (0), [&] { ++b; });
+    first.cancel ();
+    wait_for (b, 1);
+    second.release ();
+    std::printf ("reuse ok\n");
+}
+
+int main ()
+{
+    std::thread ([] {
+        std::this_thread::sleep_for (seconds (WATCHDOG));
+        std::fprintf (stderr, "watchdog: test hung\n");
+        std::abort ();
+    }).detach ();
+    test_scope ();
+    test_move ();
+    test_reuse ();
+    return 0;
+}
@@ -0,0 +1,77 @@
+/*
+ * tsc.c
+ *
+ * The time-stamp counter clock; see tsc.h.
+ */
+#if defined(__x86_64__) || defined(__i386__)
+# include <cpuid.h>
+#endif
+#include "errors.h"
+#include "alarm_clock.h"
+#include "tsc.h"
+
+#define TSC_CALIBRATE   ((int64_t)10000000) /* 10 ms */
+
+int64_t tsc_clock_fallback (void)
+{
+    return alarm_clock_now ();
+}
+
+/*
+ * Whether the processor has an invariant counter: CPUID leaf
+ * 0x80000007, EDX bit 8.
+ */
+static int tsc_invariant (void)
+{
+#if defined(__x86_64__) || defined(__i386__)
+    unsigned eax, ebx, ecx, edx;
+
+    if (__get_cpuid (0x80000007, &eax, &ebx, &ecx, &edx))
+        return (edx >> 8) & 1;
+#endif
+    return 0;
+}
+
+void tsc_clock_anchor (tsc_clock_t *clock)
+{
+#if defined(__x86_64__) || defined(__i386__)
+    clock->base_tsc = __rdtsc ();
+#endif
+    clock->base_ns = alarm_clock_now ();
+}
+
+/*
+ * Time the counter against the engine's clock for TSC_CALIBRATE,
+ * spinning, and anchor it. The rate is taken on CLOCK_MONOTONIC,
+ * which is as good as the engine's clock or better (the coarse one
+ * only moves every few milliseconds). Calibrating takes the time
+ * it measures over, so do it once, before polling begins.
+ */
+void tsc_clock_init (tsc_clock_t *clock)
+{
+#if defined(__x86_64__) || defined(__i386__)
+    struct timespec now;
+    int64_t start_ns, end_ns;
+    uint64_t start_tsc, end_tsc;
+
+    clock->invariant = tsc_invariant ();
+    if (clock->invariant) {
+        clock_gettime (CLOCK_MONOTONIC, &now);
+        start_tsc = __rdtsc ();
+        start_ns = (int64_t)now.tv_sec * 1000000000 + now.tv_nsec;
+        do {
+            clock_gettime (CLOCK_MONOTONIC, &now);
+            end_tsc = __rdtsc ();
+            end_ns = (int64_t)now.tv_sec * 1000000000 + now.tv_nsec;
+        } while (end_ns - start_ns < TSC_CALIBRATE);
+        if (end_tsc > start_tsc)
+            clock->mult = (uint64_t)(((unsigned __int128)
+                (end_ns - start_ns) << 32) / (end_tsc - start_tsc));
+        else
+            clock->invariant = 0;
+    }
+#else
+    clock->invariant = 0;
+#endif
+    tsc_clock_anchor (clock);
+}
@@ -0,0 +1,61 @@
+#ifndef __tsc_h
+#define __tsc_h
+
+#include <stdint.h>
+#if defined(__x86_64__) || defined(__i386__)
+# include <x86intrin.h>
+#endif
+
+/*
+ * A clock read from the processor's time-stamp counter, for threads
+ * that read the time in a tight loop, where even the vDSO's
+ * clock_gettime is too slow. The counter is calibrated against the
+ * engine's clock (alarm_clock_now), and a reading is that clock's
+ * time at the last anchor plus the counter ticks since, scaled:
+ *
+ *      tsc_clock_init (&clock);
+ *      ...
+ *      now = tsc_clock_now (&clock);
+ *
+ * Only an invariant counter, which ticks at a fixed rate whatever
+ * the processor's frequency and power state, and in step on every
+ * processor, will do. Where there is none (or not an x86), the
+ * clock reads alarm_clock_now instead, and says so in invariant.
+ *
+ * The engine's clock may be slewed by NTP, and the calibration is
+ * not exact, so the two drift apart slowly; the owner calls
+ * tsc_clock_anchor every TSC_ANCHOR_INTERVAL or so to bring them
+ * back together. A clock belongs to one thread.
+ */
+#define TSC_ANCHOR_INTERVAL     ((int64_t)100000000) /* 100 ms */
+
+typedef struct tsc_clock_tag {
+    int                 invariant; /* Whether the counter is used */
+    uint64_t            base_tsc; /* Counter at the last anchor */
+    int64_t             base_ns; /* alarm_clock_now at the last anchor */
+    uint64_t            mult;   /* Nanoseconds a tick, times 2^32 */
+} tsc_clock_t;
+
+extern void tsc_clock_init (tsc_clock_t *clock);
+extern void tsc_clock_anchor (tsc_clock_t *clock);
+extern int64_t tsc_clock_fallback (void);
+
+static inline int64_t tsc_clock_now (tsc_clock_t *clock)
+{
+#if defined(__x86_64__) || defined(__i386__)
+    if (clock->invariant)
+        return clock->base_ns + (int64_t)(((unsigned __int128)
+            (__rdtsc () - clock->base_tsc) * clock->mult) >> 32);
+#endif
+    return tsc_clock_fallback ();
+}
+
+/* What a thread polling in a tight loop does between polls. */
+static inline void tsc_relax (void)
+{
+#if defined(__x86_64__) || defined(__i386__)
+    _mm_pause ();
+#endif
+}
+
+#endif